@@ -0,0 +1,178 @@
+#!/usr/bin/env python
+"""Scaling benchmark for wireroute: runs every input in every mode at every
+thread count a few times and writes one CSV row per (input, mode, threads)
+with the median times, the speedup and efficiency over the 1-thread run and
+the final cost. With --baseline, rows that got slower than an earlier CSV by
+more than --tolerance are reported and the exit status is 1.
+"""
+from __future__ import print_function
+
+import argparse
+import csv
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+FIELDS = ['input', 'mode', 'threads', 'runs', 'init_s', 'compute_s', 'output_s',
+          'speedup', 'efficiency', 'initial_cost', 'final_cost', 'max_occupancy',
+          'iterations', 'error']
+
+DEFAULT_INPUTS = ['inputs/timeinput/*.txt', 'inputs/problemsize/*/*.txt']
+
+
+def median(values):
+    values = sorted(values)
+    n = len(values)
+    if n == 0:
+        return None
+    if n % 2:
+        return values[n // 2]
+    return (values[n // 2 - 1] + values[n // 2]) / 2.0
+
+
+def parse_run(text):
+    """times and costs printed by one wireroute run"""
+    def number(pattern, cast=float):
+        found = re.findall(pattern, text)
+        return cast(found[-1]) if found else None
+
+    result = {
+        'init_s': number(r'Initialization Time: ([0-9]+\.[0-9]+)'),
+        'compute_s': number(r'Computation Time: ([0-9]+\.[0-9]+)'),
+        'output_s': number(r'Output Time: ([0-9]+\.[0-9]+)'),
+        'initial_cost': number(r'Initial cost: (\d+)', int),
+        # of the routes written out, which may be an earlier iteration's
+        'final_cost': number(r'Final cost: (\d+)', int),
+        'max_occupancy': number(r'Final cost: \d+, max occupancy (\d+)', int),
+        'iterations': len(re.findall(r'Iteration \d+: cost', text)),
+        'fallback': 'Falling back to within mode.' in text,
+    }
+    return result
+
+
+def run_config(binary, workdir, input_path, mode, threads, repeat, extra):
+    """median of `repeat` runs of one configuration, as a CSV row"""
+    name = os.path.basename(input_path)
+    cmd = [binary, '-f', name, '-n', str(threads), '-m', mode] + extra
+    row = {'input': input_path, 'mode': mode, 'threads': threads, 'runs': 0, 'error': ''}
+    runs = []
+    for _ in range(repeat):
+        proc = subprocess.Popen(cmd, cwd=workdir, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        out = proc.communicate()[0].decode('utf-8', 'replace')
+        if proc.returncode != 0:
+            lines = [l for l in out.splitlines() if l.startswith('Error')]
+            row['error'] = lines[-1] if lines else 'exit status %d' % proc.returncode
+            break
+        runs.append(parse_run(out))
+
+    row['runs'] = len(runs)
+    if runs:
+        for key in ('init_s', 'compute_s', 'output_s'):
+            row[key] = median([r[key] for r in runs if r[key] is not None])
+        # the costs of the last run; they only vary between runs in the racy modes
+        for key in ('initial_cost', 'final_cost', 'max_occupancy', 'iterations'):
+            row[key] = runs[-1][key]
+        if any(r['fallback'] for r in runs):
+            row['mode'] = mode + '->within'
+    return row
+
+
+def load_baseline(path):
+    rows = {}
+    with open(path) as f:
+        for row in csv.DictReader(f):
+            if row.get('compute_s'):
+                rows[(row['input'], row['mode'], row['threads'])] = float(row['compute_s'])
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--binary', default='./wireroute', help='wireroute to run (default ./wireroute)')
+    parser.add_argument('--threads', default='1,2,4,8,16', help='comma separated thread counts')
+    parser.add_argument('--modes', default='across,atomic,within,color,region', help='comma separated -m modes')
+    parser.add_argument('--inputs', nargs='*', default=DEFAULT_INPUTS,
+                        help='input files or globs (default: timeinput and problemsize)')
+    parser.add_argument('--repeat', type=int, default=3, help='runs per configuration (default 3)')
+    parser.add_argument('--args', default='', help='extra wireroute options, e.g. "-b steal -o bin"')
+    parser.add_argument('--out', default='bench.csv', help='CSV to write (default bench.csv)')
+    parser.add_argument('--baseline', help='earlier CSV to compare the compute times against')
+    parser.add_argument('--tolerance', type=float, default=0.10,
+                        help='slowdown over the baseline that counts as a regression (default 0.10)')
+    args = parser.parse_args()
+
+    binary = os.path.abspath(args.binary)
+    threads = [int(t) for t in args.threads.split(',') if t]
+    modes = [m for m in args.modes.split(',') if m]
+    extra = args.args.split()
+    inputs = []
+    for pattern in args.inputs:
+        matches = sorted(glob.glob(pattern))
+        inputs += matches if matches else [pattern]
+    if not os.path.exists(binary):
+        print('Error: %s not found, run make first.' % binary)
+        return 1
+
+    # wireroute names its output files after the input, so every run happens
+    # in a scratch directory holding a link to the input
+    workdir = tempfile.mkdtemp(prefix='wireroute_bench_')
+    rows = []
+    try:
+        for input_path in inputs:
+            link = os.path.join(workdir, os.path.basename(input_path))
+            if os.path.lexists(link):
+                os.remove(link)
+            os.symlink(os.path.abspath(input_path), link)
+            for mode in modes:
+                serial = None
+                for n in threads:
+                    row = run_config(binary, workdir, input_path, mode, n, args.repeat, extra)
+                    compute = row.get('compute_s')
+                    if n == 1 and compute:
+                        serial = compute
+                    if serial and compute:
+                        row['speedup'] = serial / compute
+                        row['efficiency'] = row['speedup'] / n
+                    rows.append(row)
+                    print('%-40s %-8s %3d threads: compute %s, speedup %s, cost %s %s' % (
+                        input_path, row['mode'], n,
+                        '%.3fs' % compute if compute is not None else '-',
+                        '%.2f' % row['speedup'] if 'speedup' in row else '-',
+                        row.get('final_cost', '-'), row['error']))
+                    sys.stdout.flush()
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    with open(args.out, 'w') as f:
+        writer = csv.DictWriter(f, FIELDS, extrasaction='ignore', lineterminator='\n')
+        writer.writeheader()
+        for row in rows:
+            out = dict(row)
+            for key in ('init_s', 'compute_s', 'output_s'):
+                if out.get(key) is not None:
+                    out[key] = '%.6f' % out[key]
+            for key in ('speedup', 'efficiency'):
+                if out.get(key) is not None:
+                    out[key] = '%.3f' % out[key]
+            writer.writerow(out)
+    print('Wrote %d rows to %s.' % (len(rows), args.out))
+
+    failed = [r for r in rows if r['error']]
+    if args.baseline:
+        baseline = load_baseline(args.baseline)
+        for row in rows:
+            old = baseline.get((row['input'], row['mode'], str(row['threads'])))
+            new = row.get('compute_s')
+            if old and new and new > old * (1 + args.tolerance):
+                print('Regression: %s %s %d threads: compute %.3fs, was %.3fs (+%.0f%%)' % (
+                    row['input'], row['mode'], row['threads'], new, old, 100 * (new / old - 1)))
+                failed.append(row)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
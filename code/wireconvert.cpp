@@ -0,0 +1,127 @@
+/**
+ * Turns the binary route and cost files of wireroute -o bin back into the
+ * text files validate.py and WireGrapher read
+ */
+
+#include "wireformat.h"
+#include "wirewalk.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void show_help(const char *program_path) {
+    printf("Usage: %s <binary_file> [<text_file>]\n", program_path);
+    printf("\n");
+    printf("Writes the text version of a route or cost file from wireroute -o bin,\n");
+    printf("by default next to it with the .bin suffix removed.\n");
+}
+
+static bool read_fields(const unsigned char **p, const unsigned char *end, uint64_t *fields, int num_fields){
+    for (int f = 0; f < num_fields; f++){
+        if (!varint_get(p, end, &fields[f])) return false;
+    }
+    return true;
+}
+
+static bool convert_costs(const unsigned char *p, const unsigned char *end, FILE *out){
+    uint64_t header[3];
+    if (!read_fields(&p, end, header, 3) || header[0] != WIREFILE_VERSION) return false;
+    int dim_y = (int)header[1], dim_x = (int)header[2];
+
+    fprintf(out, "%d %d\n", dim_y, dim_x);
+    for (int row = 0; row < dim_y; row++){
+        for (int col = 0; col < dim_x; ){
+            uint64_t value, run;
+            if (!varint_get(&p, end, &value) || !varint_get(&p, end, &run)) return false;
+            if (run == 0 || run > (uint64_t)(dim_x - col)) return false;
+            for (uint64_t i = 0; i < run; i++){
+                fprintf(out, "%d ", (int)value);
+            }
+            col += (int)run;
+        }
+        fprintf(out, "\n");
+    }
+    return p == end;
+}
+
+static bool convert_routes(const unsigned char *p, const unsigned char *end, FILE *out){
+    uint64_t header[4];
+    if (!read_fields(&p, end, header, 4) || header[0] != WIREFILE_VERSION) return false;
+    int dim_y = (int)header[1], dim_x = (int)header[2], num_wires = (int)header[3];
+
+    fprintf(out, "%d %d\n", dim_y, dim_x);
+    fprintf(out, "%d \n", num_wires);
+    for (int w = 0; w < num_wires; w++){
+        uint64_t v[5];
+        if (!read_fields(&p, end, v, 5)) return false;
+        int startx = (int)v[0], starty = (int)v[1];
+        int endx = startx + (int)unzigzag(v[2]), endy = starty + (int)unzigzag(v[3]);
+        bool vertical_first = v[4] & 1;
+        int bend = (vertical_first ? starty : startx) + (int)unzigzag(v[4] >> 1);
+
+        wire_t wire = {startx, starty, endx, endy, bend, vertical_first};
+        route_points(wire, [out](int x, int y){ fprintf(out, "%d %d ", x, y); });
+        fprintf(out, "\n");
+    }
+    return p == end;
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        show_help(argv[0]);
+        return 1;
+    }
+    const char *input_filename = argv[1];
+
+    char output_filename[256];
+    if (argc == 3) {
+        snprintf(output_filename, sizeof(output_filename), "%s", argv[2]);
+    } else {
+        size_t len = strlen(input_filename);
+        if (len < 5 || strcmp(input_filename + len - 4, ".bin") != 0 || len - 4 >= sizeof(output_filename)) {
+            printf("Error: %s does not end in .bin, name the text file.\n", input_filename);
+            return 1;
+        }
+        memcpy(output_filename, input_filename, len - 4);
+        output_filename[len - 4] = '\0';
+    }
+
+    FILE *input = fopen(input_filename, "rb");
+    if (!input) {
+        printf("Unable to open file: %s.\n", input_filename);
+        return 1;
+    }
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    unsigned char *data = (unsigned char*)malloc(size > 0 ? size : 1);
+    bool read_ok = size >= 4 && fread(data, 1, size, input) == (size_t)size;
+    fclose(input);
+
+    bool is_costs = read_ok && memcmp(data, WIREFILE_COSTS_MAGIC, 4) == 0;
+    bool is_routes = read_ok && memcmp(data, WIREFILE_ROUTES_MAGIC, 4) == 0;
+    if (!is_costs && !is_routes) {
+        printf("Error: %s is not a binary route or cost file.\n", input_filename);
+        free(data);
+        return 1;
+    }
+
+    FILE *output = fopen(output_filename, "w");
+    if (!output) {
+        printf("Error: Cannot write %s.\n", output_filename);
+        free(data);
+        return 1;
+    }
+    setvbuf(output, NULL, _IOFBF, 1 << 20);
+
+    const unsigned char *body = data + 4, *end = data + size;
+    bool ok = is_costs ? convert_costs(body, end, output) : convert_routes(body, end, output);
+    if (fclose(output) != 0) ok = false;
+    free(data);
+
+    if (!ok) {
+        printf("Error: %s is truncated or corrupt.\n", input_filename);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * Binary route and cost files (wireroute -o bin), read back by wireconvert
+ *
+ * Both files start with a 4-byte magic followed by varints:
+ *   routes: "WRRT" version dim_y dim_x num_wires, then per wire
+ *           startx starty zz(endx - startx) zz(endy - starty) bend
+ *           where bend = zz(bend - start) << 1 | vertical_first, start being
+ *           startx for horizontal-first routes and starty otherwise
+ *   costs:  "WRCS" version dim_y dim_x, then per row (value, run length)
+ *           pairs that add up to dim_x cells
+ * Varints are unsigned LEB128 and zz() is the zigzag mapping of a signed value.
+ */
+
+#ifndef __WIREFORMAT_H__
+#define __WIREFORMAT_H__
+
+#include <stdint.h>
+
+#define WIREFILE_ROUTES_MAGIC "WRRT"
+#define WIREFILE_COSTS_MAGIC "WRCS"
+#define WIREFILE_VERSION 1
+
+/* longest varint of a 64-bit value */
+#define VARINT_MAX 10
+
+static inline uint64_t zigzag(int64_t v){
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v){
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/* append v at out, returns the end of the encoding */
+static inline char *varint_put(char *out, uint64_t v){
+    while (v >= 0x80){
+        *out++ = (char)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (char)v;
+    return out;
+}
+
+/* decode a varint at *p, false if the input ends first */
+static inline bool varint_get(const unsigned char **p, const unsigned char *end, uint64_t *v){
+    uint64_t result = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7){
+        unsigned char byte = *(*p)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)){
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
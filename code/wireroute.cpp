@@ -4,6 +4,9 @@
  */
 
 #include "wireroute.h"
+#include "wireformat.h"
+#include "wiresimd.h"
+#include "wirewalk.h"
 #include <assert.h>
 #include <chrono>
 #include <cstdio>
@@ -12,6 +15,12 @@
 #include <omp.h>
 #include <algorithm>
 #include <cmath>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 static int _argc;
 static const char **_argv;
@@ -44,706 +53,3089 @@ static void show_help(const char *program_path) {
     printf("\t-f <input_filename> (required)\n");
     printf("\t-n <num_of_threads> (required)\n");
     printf("\t-p <SA_prob>\n");
-    printf("\t-i <SA_iters>\n");
+    printf("\t-i <SA_iters> (maximum number of iterations)\n");
+    printf("\t-d <SA_decay> (random-move probability is SA_prob * SA_decay^iteration)\n");
+    printf("\t-t <threshold> (stop once an iteration improves the cost by less than this fraction)\n");
+    printf("\t-m <mode> across (default, critical sections), atomic (lock-free grid updates)\n");
+    printf("\t          within (candidates of one wire split across threads)\n");
+    printf("\t          color (batches of wires with disjoint bounding boxes, falls back to\n");
+    printf("\t          within when the batches hold too little parallel work)\n");
+    printf("\t          or region (one strip of the grid per thread, sized by wire density;\n");
+    printf("\t          wires crossing strips are routed last under per-strip locks)\n");
+    printf("\t-c <objective> sum (default, route cost) or max (highest cell on the route, then cost)\n");
+    printf("\t-o <format> text (default) or bin (compact, wireconvert turns it back into text)\n");
+    printf("\t-w <bits> 8, 16 or 32 bits per grid cell, widened when a cell saturates\n");
+    printf("\t          (default auto: the narrowest that holds the number of wires)\n");
+    printf("\t-l <layout> rows (default, row major), tiles (%dx%d tiles, for vertical walks)\n",
+           GRID_TILE, GRID_TILE);
+    printf("\t            or dual (row major plus a transposed copy for column reads)\n");
+    printf("\t-k <kernels> auto (default, the widest this CPU runs), avx2, sse4.1 or scalar;\n");
+    printf("\t             routes are the same with any of them\n");
+    printf("\t-b <balance> static (default, one block of wires per thread), lpt (heaviest wires\n");
+    printf("\t             first, handed out one by one) or steal (blocks of equal estimated work,\n");
+    printf("\t             idle threads steal from busy ones); for -m across and atomic\n");
+    printf("\t-r <order> input (default), hilbert or morton: route the wires along a space-filling\n");
+    printf("\t           curve through their centers (routes are still written in input order)\n");
+    printf("\t-s <seed> (routes only depend on the seed, not on -n, for -m within and color)\n");
+    printf("\t-q <threshold> cells holding more than this many wires count as congested in the\n");
+    printf("\t               quality printed after every iteration (default 1)\n");
+    printf("\t-j <report_file> write per-thread counters (candidates, cells read and written, improved\n");
+    printf("\t                 and random moves, lock wait and hold, busy time) and per-iteration\n");
+    printf("\t                 wall time, cost and max occupancy as JSON\n");
+    printf("\t-validate <routes_file> instead of routing, check the routes (text or bin) against the\n");
+    printf("\t                        input: one contiguous route with at most two bends per wire,\n");
+    printf("\t                        and the cost file against the occupancy they give\n");
+    printf("\t-validate_costs <cost_file> (default: routes_file with output_ replaced by cost_)\n");
 }
 
-static void print_cost(int dim_x, int dim_y, cost_t* costs){
+// typed views of a grid_t: at(x, y) is cell (x, y), and run(x, len) says how
+// many of the len cells from (x, y) rightwards are contiguous in memory, so
+// rows can be walked as a few plain arrays in any layout. Views with
+// has_columns also keep a transposed copy, column(x, y) points at cell (x, y)
+// in it and cells (x, y + 1), (x, y + 2), ... follow contiguously.
+template <typename CELL>
+struct rows_view_t {
+    typedef CELL cell_t;
+    static const bool has_columns = false;
+    CELL *cells;
+    int dim_x;
+
+    rows_view_t(void *cells, int dim_x, int dim_y) : cells((CELL*)cells), dim_x(dim_x) {}
+    CELL &at(int x, int y) const { return cells[x + (size_t)dim_x * y]; }
+    int run(int x, int len) const { return len; }
+    CELL *column(int x, int y) const { return NULL; }
+};
+
+template <typename CELL>
+struct tiles_view_t {
+    typedef CELL cell_t;
+    static const bool has_columns = false;
+    CELL *cells;
+    int tiles_x;
+
+    tiles_view_t(void *cells, int dim_x, int dim_y) : cells((CELL*)cells), tiles_x((dim_x + GRID_TILE - 1) / GRID_TILE) {}
+    CELL &at(int x, int y) const {
+        unsigned int ux = x, uy = y;
+        size_t tile = (size_t)(uy / GRID_TILE) * tiles_x + ux / GRID_TILE;
+        return cells[tile * GRID_TILE * GRID_TILE + (uy % GRID_TILE) * GRID_TILE + ux % GRID_TILE];
+    }
+    int run(int x, int len) const { return std::min(len, GRID_TILE - (int)((unsigned int)x % GRID_TILE)); }
+    CELL *column(int x, int y) const { return NULL; }
+};
+
+// row major, followed by the transposed copy
+template <typename CELL>
+struct dual_view_t {
+    typedef CELL cell_t;
+    static const bool has_columns = true;
+    CELL *cells;
+    CELL *columns;
+    int dim_x;
+    int dim_y;
+
+    dual_view_t(void *cells, int dim_x, int dim_y)
+        : cells((CELL*)cells), columns((CELL*)cells + (size_t)dim_x * dim_y), dim_x(dim_x), dim_y(dim_y) {}
+    CELL &at(int x, int y) const { return cells[x + (size_t)dim_x * y]; }
+    int run(int x, int len) const { return len; }
+    CELL *column(int x, int y) const { return &columns[y + (size_t)dim_y * x]; }
+};
+
+// run the statement with `view` bound to the typed view of a grid_t, for
+// whatever cell width and layout it has
+#define GRID_VISIT_LAYOUT(VIEW, grid, dim_x, dim_y, ...) do { \
+    if ((grid)->width == CELL_8) { VIEW<uint8_t> view((grid)->cells, dim_x, dim_y); __VA_ARGS__; } \
+    else if ((grid)->width == CELL_16) { VIEW<uint16_t> view((grid)->cells, dim_x, dim_y); __VA_ARGS__; } \
+    else { VIEW<cost_t> view((grid)->cells, dim_x, dim_y); __VA_ARGS__; } \
+} while (0)
+
+#define GRID_VISIT(grid, dim_x, dim_y, ...) do { \
+    if ((grid)->layout == LAYOUT_TILES) GRID_VISIT_LAYOUT(tiles_view_t, grid, dim_x, dim_y, __VA_ARGS__); \
+    else if ((grid)->layout == LAYOUT_DUAL) GRID_VISIT_LAYOUT(dual_view_t, grid, dim_x, dim_y, __VA_ARGS__); \
+    else GRID_VISIT_LAYOUT(rows_view_t, grid, dim_x, dim_y, __VA_ARGS__); \
+} while (0)
+
+template <typename GRID>
+static void print_cost(int dim_x, int dim_y, GRID grid){
     printf("--------------PRINTING COST ARRAY----------------\n");
     printf("%d %d\n", dim_y, dim_x);
 
         for (int row = 0; row < dim_y; row++){
             for (int col = 0; col < dim_x; col++){
-                printf( "%d ", costs[col + row * dim_x]);
+                printf( "%d ", grid.at(col, row));
             }
             printf("\n");
         }
     printf("---------------- DONE PRINTING ------------------\n");
 }
 
-// calculate the cost of path for one wire using the cost array
-static int cost_calc(wire_t wire, cost_t *costs, int dim_x, int dim_y){
-    //printf("ENTERING COST_CALCULATION......\n");
+// per-thread scratch used to score every candidate route of one wire in O(1):
+// all arrays are indexed relative to the wire's bounding box (x0, y0). One is
+// kept per thread for the whole run and only grows, so routing allocates
+// nothing per wire.
+typedef struct {
+    int cap_w, cap_h;
+    long long allocs; // number of times the buffers had to grow
+    bool track_max;   // also fill the *max arrays, for OBJECTIVE_MAX
+    const simd_t *simd; // kernels for the row scans and prefix_best
+    int *colsum;    // sum of each bbox column between the two end rows
+    int *rowsum;    // sum of each bbox row between the two end columns
+    int *start_row; // exclusive prefix sums along the row of the start point
+    int *end_row;   // exclusive prefix sums along the row of the end point
+    int *start_col; // exclusive prefix sums along the column of the start point
+    int *end_col;   // exclusive prefix sums along the column of the end point
+    int *colmax;    // max of each bbox column
+    int *rowmax;    // max of each bbox row
+    int *start_row_max; // running max along the start row, from the start point
+    int *end_row_max;   // running max along the end row, from the end point
+    int *start_col_max; // running max along the start column, from the start point
+    int *end_col_max;   // running max along the end column, from the end point
+    int *bend_col;      // cost of the horizontal-first route bending at each bbox column
+    int *bend_row;      // cost of the vertical-first route bending at each bbox row
+    int *bend_col_max;  // highest cell on the route bending at each bbox column
+    int *bend_row_max;  // highest cell on the route bending at each bbox row
+} prefix_t;
+
+static void prefix_reserve(prefix_t *p, int w, int h){
+    if (w > p->cap_w){
+        p->allocs++;
+        p->colsum = (int*)realloc(p->colsum, w * sizeof(int));
+        p->start_row = (int*)realloc(p->start_row, (w + 1) * sizeof(int));
+        p->end_row = (int*)realloc(p->end_row, (w + 1) * sizeof(int));
+        p->colmax = (int*)realloc(p->colmax, w * sizeof(int));
+        p->start_row_max = (int*)realloc(p->start_row_max, w * sizeof(int));
+        p->end_row_max = (int*)realloc(p->end_row_max, w * sizeof(int));
+        p->bend_col = (int*)realloc(p->bend_col, w * sizeof(int));
+        p->bend_col_max = (int*)realloc(p->bend_col_max, w * sizeof(int));
+        p->cap_w = w;
+    }
+    if (h > p->cap_h){
+        p->allocs++;
+        p->rowsum = (int*)realloc(p->rowsum, h * sizeof(int));
+        p->start_col = (int*)realloc(p->start_col, (h + 1) * sizeof(int));
+        p->end_col = (int*)realloc(p->end_col, (h + 1) * sizeof(int));
+        p->rowmax = (int*)realloc(p->rowmax, h * sizeof(int));
+        p->start_col_max = (int*)realloc(p->start_col_max, h * sizeof(int));
+        p->end_col_max = (int*)realloc(p->end_col_max, h * sizeof(int));
+        p->bend_row = (int*)realloc(p->bend_row, h * sizeof(int));
+        p->bend_row_max = (int*)realloc(p->bend_row_max, h * sizeof(int));
+        p->cap_h = h;
+    }
+}
 
-    int x_step, y_step;
-    int total_cost = 0;
+static void prefix_free(prefix_t *p){
+    free(p->colsum);
+    free(p->rowsum);
+    free(p->start_row);
+    free(p->end_row);
+    free(p->start_col);
+    free(p->end_col);
+    free(p->colmax);
+    free(p->rowmax);
+    free(p->start_row_max);
+    free(p->end_row_max);
+    free(p->start_col_max);
+    free(p->end_col_max);
+    free(p->bend_col);
+    free(p->bend_row);
+    free(p->bend_col_max);
+    free(p->bend_row_max);
+}
 
-    if (wire.startx == wire.endx){
-        if (wire.starty < wire.endy){
-            for (y_step = wire.starty; y_step <= wire.endy; y_step++){
-                total_cost += costs[wire.startx + dim_x * y_step];
-            }
+// turn raw values stored in p[1..n] into exclusive prefix sums
+static void exclusive_scan(int *p, int n){
+    p[0] = 0;
+    for (int i = 1; i <= n; i++){
+        p[i] += p[i - 1];
+    }
+}
+
+// out[i] = max of raw[0..i], or of raw[i..n-1] when walking from the end
+static void running_max(const int *raw, int *out, int n, bool from_end){
+    int m = 0;
+    if (from_end){
+        for (int i = n - 1; i >= 0; i--){
+            m = std::max(m, raw[i]);
+            out[i] = m;
+        }
+    } else{
+        for (int i = 0; i < n; i++){
+            m = std::max(m, raw[i]);
+            out[i] = m;
+        }
+    }
+}
+
+// contiguous cells [x, x + len) of one bbox row: add them to the row's total
+// (and max), optionally accumulated into the columns. Sums alone go to the
+// vector kernels.
+template <typename CELL, bool COLSUM, bool MAX>
+static inline void scan_run(const CELL *row, int x, int len, prefix_t *p, int *row_total, int *row_max){
+    if (!MAX){
+        *row_total += COLSUM ? simd_accumulate(p->simd, row, len, p->colsum + x) : simd_sum(p->simd, row, len);
+        return;
+    }
+    int total = 0, max = 0;
+    for (int i = 0; i < len; i++){
+        total += row[i];
+        if (COLSUM) p->colsum[x + i] += row[i];
+        if (MAX){
+            max = std::max(max, (int)row[i]);
+            if (COLSUM) p->colmax[x + i] = std::max(p->colmax[x + i], (int)row[i]);
+        }
+    }
+    *row_total += total;
+    if (MAX) *row_max = std::max(*row_max, max);
+}
+
+// one bbox row, run by run
+template <typename GRID, bool COLSUM, bool MAX>
+static inline void scan_row(GRID grid, int x0, int gy, int w, prefix_t *p, int y){
+    int row_total = 0, row_max = 0;
+    for (int x = 0; x < w; ){
+        int len = grid.run(x0 + x, w - x);
+        scan_run<typename GRID::cell_t, COLSUM, MAX>(&grid.at(x0 + x, gy), x, len, p, &row_total, &row_max);
+        x += len;
+    }
+    p->rowsum[y] = row_total;
+    if (MAX) p->rowmax[y] = row_max;
+}
+
+// scan rows [y_lo, y_hi) of the bounding box of a (bent) wire, relative to its
+// bbox, and fill the row sums and start/end columns and rows. colsum (and
+// colmax) are only accumulated when with_colsum is set.
+template <typename GRID>
+static void prefix_scan_rows(prefix_t *p, wire_t wire, GRID grid,
+                             int y_lo, int y_hi, bool with_colsum){
+    int x0 = std::min(wire.startx, wire.endx);
+    int y0 = std::min(wire.starty, wire.endy);
+    int w = abs(wire.endx - wire.startx) + 1;
+    int sx = wire.startx - x0, ex = wire.endx - x0;
+    int sy = wire.starty - y0, ey = wire.endy - y0;
+
+    for (int y = y_lo; y < y_hi; y++){
+        int gy = y0 + y;
+        if (with_colsum){
+            if (p->track_max) scan_row<GRID, true, true>(grid, x0, gy, w, p, y);
+            else scan_row<GRID, true, false>(grid, x0, gy, w, p, y);
         } else{
-            for (y_step = wire.starty; y_step >= wire.endy; y_step--){
-                total_cost += costs[wire.startx + dim_x * y_step];
-            }
+            if (p->track_max) scan_row<GRID, false, true>(grid, x0, gy, w, p, y);
+            else scan_row<GRID, false, false>(grid, x0, gy, w, p, y);
+        }
+        if (!GRID::has_columns){
+            p->start_col[y + 1] = grid.at(x0 + sx, gy);
+            p->end_col[y + 1] = grid.at(x0 + ex, gy);
+        }
+
+        if (y == sy){
+            for (int x = 0; x < w; x++) p->start_row[x + 1] = grid.at(x0 + x, gy);
         }
-    } else if (wire.starty == wire.endy){
-        if (wire.startx < wire.endx){
-            for (x_step = wire.startx; x_step <= wire.endx; x_step++){
-                total_cost += costs[x_step + dim_x * wire.endy];
+        if (y == ey){
+            for (int x = 0; x < w; x++) p->end_row[x + 1] = grid.at(x0 + x, gy);
+        }
+    }
+
+    // the start and end columns read contiguously from the transposed copy
+    if (GRID::has_columns){
+        const typename GRID::cell_t *start_col = grid.column(x0 + sx, y0);
+        const typename GRID::cell_t *end_col = grid.column(x0 + ex, y0);
+        for (int y = y_lo; y < y_hi; y++){
+            p->start_col[y + 1] = start_col[y];
+            p->end_col[y + 1] = end_col[y];
+        }
+    }
+}
+
+// column sums for bbox columns [x_lo, x_hi), still walked row by row
+template <typename GRID>
+static void prefix_scan_cols(prefix_t *p, wire_t wire, GRID grid,
+                             int x_lo, int x_hi){
+    int x0 = std::min(wire.startx, wire.endx);
+    int y0 = std::min(wire.starty, wire.endy);
+    int h = abs(wire.endy - wire.starty) + 1;
+
+    memset(&p->colsum[x_lo], 0, (x_hi - x_lo) * sizeof(int));
+    if (p->track_max) memset(&p->colmax[x_lo], 0, (x_hi - x_lo) * sizeof(int));
+    for (int y = 0; y < h; y++){
+        for (int x = x_lo; x < x_hi; ){
+            int len = grid.run(x0 + x, x_hi - x);
+            const typename GRID::cell_t *row = &grid.at(x0 + x, y0 + y);
+            simd_accumulate(p->simd, row, len, p->colsum + x);
+            if (p->track_max){
+                for (int i = 0; i < len; i++){
+                    p->colmax[x + i] = std::max(p->colmax[x + i], (int)row[i]);
+                }
             }
+            x += len;
+        }
+    }
+}
+
+// turn the scanned start/end rows and columns into prefix sums (and maxima
+// running away from the start and end points)
+static void prefix_finish(prefix_t *p, wire_t wire){
+    int w = abs(wire.endx - wire.startx) + 1;
+    int h = abs(wire.endy - wire.starty) + 1;
+
+    if (p->track_max){
+        running_max(p->start_row + 1, p->start_row_max, w, wire.startx > wire.endx);
+        running_max(p->end_row + 1, p->end_row_max, w, wire.endx > wire.startx);
+        running_max(p->start_col + 1, p->start_col_max, h, wire.starty > wire.endy);
+        running_max(p->end_col + 1, p->end_col_max, h, wire.endy > wire.starty);
+    }
+    exclusive_scan(p->start_row, w);
+    exclusive_scan(p->end_row, w);
+    exclusive_scan(p->start_col, h);
+    exclusive_scan(p->end_col, h);
+}
+
+// scan the bounding box of a (bent) wire once, row by row, and build the
+// sums every candidate route needs. Must see the grid without the wire itself.
+template <typename GRID>
+static void prefix_build(prefix_t *p, wire_t wire, GRID grid){
+    int w = abs(wire.endx - wire.startx) + 1;
+    int h = abs(wire.endy - wire.starty) + 1;
+
+    prefix_reserve(p, w, h);
+    memset(p->colsum, 0, w * sizeof(int));
+    if (p->track_max) memset(p->colmax, 0, w * sizeof(int));
+    prefix_scan_rows(p, wire, grid, 0, h, true);
+    prefix_finish(p, wire);
+}
+
+// sum of the cells between bbox indices a and b (inclusive, any order)
+static inline int prefix_range(const int *prefix, int a, int b){
+    if (a > b) std::swap(a, b);
+    return prefix[b + 1] - prefix[a];
+}
+
+// number of candidate routes for a wire; candidate k < |dx| travels horizontally
+// first and bends at column startx +- (k+1), the rest travel vertically first and
+// bend at row starty +- (k-|dx|+1). This matches the order routing() enumerates.
+static int num_routes(wire_t wire){
+    return abs(wire.endx - wire.startx) + abs(wire.endy - wire.starty);
+}
+
+// cost of candidate k read from a prefix_t built for this wire
+static int prefix_cost(const prefix_t *p, wire_t wire, int k){
+    int x0 = std::min(wire.startx, wire.endx);
+    int y0 = std::min(wire.starty, wire.endy);
+    int dx = abs(wire.endx - wire.startx);
+
+    if (k < dx){
+        // start row -> bend column -> end row; the two corners are counted twice
+        int step = (wire.endx > wire.startx) ? 1 : -1;
+        int bx = wire.startx + step * (k + 1) - x0;
+        int sx = wire.startx - x0, ex = wire.endx - x0;
+        return prefix_range(p->start_row, sx, bx) + p->colsum[bx] + prefix_range(p->end_row, bx, ex)
+               - prefix_range(p->start_row, bx, bx) - prefix_range(p->end_row, bx, bx);
+    } else{
+        // start column -> bend row -> end column
+        int step = (wire.endy > wire.starty) ? 1 : -1;
+        int by = wire.starty + step * (k - dx + 1) - y0;
+        int sy = wire.starty - y0, ey = wire.endy - y0;
+        return prefix_range(p->start_col, sy, by) + p->rowsum[by] + prefix_range(p->end_col, by, ey)
+               - prefix_range(p->start_col, by, by) - prefix_range(p->end_col, by, by);
+    }
+}
+
+// highest cell on candidate k, read from a prefix_t built with track_max
+static int prefix_max(const prefix_t *p, wire_t wire, int k){
+    int x0 = std::min(wire.startx, wire.endx);
+    int y0 = std::min(wire.starty, wire.endy);
+    int dx = abs(wire.endx - wire.startx);
+
+    if (k < dx){
+        int step = (wire.endx > wire.startx) ? 1 : -1;
+        int bx = wire.startx + step * (k + 1) - x0;
+        return std::max(std::max(p->start_row_max[bx], p->colmax[bx]), p->end_row_max[bx]);
+    } else{
+        int step = (wire.endy > wire.starty) ? 1 : -1;
+        int by = wire.starty + step * (k - dx + 1) - y0;
+        return std::max(std::max(p->start_col_max[by], p->rowmax[by]), p->end_col_max[by]);
+    }
+}
+
+// what routing minimizes for candidate k: its cost, or (max cell, cost)
+// packed into one key when the prefix_t tracks maxima
+static inline long long prefix_score(const prefix_t *p, wire_t wire, int k){
+    long long sum = prefix_cost(p, wire, k);
+    if (!p->track_max) return sum;
+    return ((long long)prefix_max(p, wire, k) << 32) | sum;
+}
+
+// build candidate route k of a wire (see num_routes for the numbering)
+static wire_t make_route(wire_t wire, int k){
+    int dx = abs(wire.endx - wire.startx);
+
+    if (k < dx){
+        int step = (wire.endx > wire.startx) ? 1 : -1;
+        wire.vertical_first = false;
+        wire.bend = wire.startx + step * (k + 1);
+    } else{
+        int step = (wire.endy > wire.starty) ? 1 : -1;
+        wire.vertical_first = true;
+        wire.bend = wire.starty + step * (k - dx + 1);
+    }
+    return wire;
+}
+
+// inverse of make_route for a bent wire
+static int route_index(wire_t wire){
+    if (wire.vertical_first){
+        return abs(wire.endx - wire.startx) + abs(wire.bend - wire.starty) - 1;
+    }
+    return abs(wire.bend - wire.startx) - 1;
+}
+
+// counter-based random numbers: every wire gets its own stream derived from
+// (seed, iteration, wire id), so the random choices do not depend on which
+// thread routes a wire or in what order, and no generator state is shared
+typedef struct {
+    uint64_t state;
+} rng_t;
+
+// splitmix64 finalizer, a bijective 64-bit mix
+static inline uint64_t rng_mix(uint64_t z){
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// seed of one iteration, combined with a wire id by rng_wire
+static inline uint64_t rng_iteration(uint64_t seed, int iteration){
+    return rng_mix(rng_mix(seed) + (uint64_t)iteration);
+}
+
+static inline rng_t rng_wire(uint64_t iteration_seed, int wid){
+    rng_t rng = {rng_mix(iteration_seed ^ ((uint64_t)wid * 0x9e3779b97f4a7c15ULL))};
+    return rng;
+}
+
+static inline uint64_t rng_next(rng_t *rng){
+    rng->state += 0x9e3779b97f4a7c15ULL;
+    return rng_mix(rng->state);
+}
+
+// uniform integer in [0, n)
+static inline int rng_below(rng_t *rng, int n){
+    return (int)(((rng_next(rng) >> 32) * (uint64_t)n) >> 32);
+}
+
+// true with probability p
+static inline bool rng_chance(rng_t *rng, double p){
+    return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+// a scored candidate route; k == -1 stands for the wire's current route
+typedef struct {
+    long long cost; // see prefix_score
+    int k;
+} candidate_t;
+
+// order candidates by (cost, index) so the current route wins every tie
+static inline candidate_t min_candidate(candidate_t a, candidate_t b){
+    if (b.cost < a.cost || (b.cost == a.cost && b.k < a.k)) return b;
+    return a;
+}
+
+#pragma omp declare reduction(min_cand : candidate_t : omp_out = min_candidate(omp_out, omp_in)) \
+    initializer(omp_priv = omp_orig)
+
+// cost (and max) of bending at every bbox position along one side of n cells,
+// lead/mid/trail being the start side, the crossing sums and the end side.
+// With the two corners taken out, prefix_cost of the bend at b is
+//   lead[b] + mid[b] - trail[b + 1] + trail[n]  for step +1 (bends 1..n-1)
+//   lead[n] - lead[b + 1] + mid[b] + trail[b]   for step -1 (bends 0..n-2)
+// i.e. a few shifted arrays added up, which the kernels do a vector at a time.
+static void prefix_bends(const simd_t *simd, int n, int step, int *cost, const int *lead, const int *mid,
+                         const int *trail, int *max, const int *lead_max, const int *mid_max,
+                         const int *trail_max){
+    int b0 = (step > 0) ? 1 : 0;
+    if (step > 0) simd->bends(cost + 1, trail[n], lead + 1, 1, mid + 1, trail + 2, -1, n - 1);
+    else simd->bends(cost, lead[n], lead + 1, -1, mid, trail, 1, n - 1);
+    if (max) simd->max3(max + b0, lead_max + b0, mid_max + b0, trail_max + b0, n - 1);
+}
+
+// best candidate of a bent wire from a prefix_t built for it: every
+// candidate is scored at once, then picked in the order of min_candidate, so
+// this is the same as reducing prefix_score over all k
+static candidate_t prefix_best(prefix_t *p, wire_t wire){
+    int x0 = std::min(wire.startx, wire.endx);
+    int y0 = std::min(wire.starty, wire.endy);
+    int dx = abs(wire.endx - wire.startx);
+    int dy = abs(wire.endy - wire.starty);
+    int step_x = (wire.endx > wire.startx) ? 1 : -1;
+    int step_y = (wire.endy > wire.starty) ? 1 : -1;
+    bool track_max = p->track_max;
+
+    prefix_bends(p->simd, dx + 1, step_x, p->bend_col, p->start_row, p->colsum, p->end_row,
+                 track_max ? p->bend_col_max : NULL, p->start_row_max, p->colmax, p->end_row_max);
+    prefix_bends(p->simd, dy + 1, step_y, p->bend_row, p->start_col, p->rowsum, p->end_col,
+                 track_max ? p->bend_row_max : NULL, p->start_col_max, p->rowmax, p->end_col_max);
+
+    candidate_t best = {prefix_score(p, wire, route_index(wire)), -1};
+    for (int k = 0; k < dx; k++){
+        int bx = wire.startx + step_x * (k + 1) - x0;
+        long long cost = p->bend_col[bx];
+        if (track_max) cost |= (long long)p->bend_col_max[bx] << 32;
+        candidate_t cand = {cost, k};
+        best = min_candidate(best, cand);
+    }
+    for (int k = 0; k < dy; k++){
+        int by = wire.starty + step_y * (k + 1) - y0;
+        long long cost = p->bend_row[by];
+        if (track_max) cost |= (long long)p->bend_row_max[by] << 32;
+        candidate_t cand = {cost, dx + k};
+        best = min_candidate(best, cand);
+    }
+    return best;
+}
+
+// check to see if the start points and end points are on a straight line
+static bool on_straight_line(wire_t wire){
+    return (wire.startx == wire.endx || wire.starty == wire.endy);
+}
+
+// histogram of cell occupancy: count[v] cells hold v wires. The global one is
+// exact; every thread also keeps one of the changes it made (counts may go
+// negative) that is merged into the global one after each iteration, so
+// add_cost/clear_cost never share a counter.
+typedef struct {
+    int size;
+    long long *count;
+    int max;         // highest occupied value (an upper bound in the per-thread ones)
+    int limit;       // highest value a cell may take in the current grid
+    bool saturated;  // an update would have passed limit and was undone
+} hist_t;
+
+static void hist_grow(hist_t *hist, int v){
+    if (v < hist->size) return;
+    int size = std::max(2 * hist->size, v + 16);
+    hist->count = (long long*)realloc(hist->count, size * sizeof(long long));
+    memset(hist->count + hist->size, 0, (size - hist->size) * sizeof(long long));
+    hist->size = size;
+}
+
+// one cell went from occupancy `from` to `to`
+static inline void hist_move(hist_t *hist, int from, int to){
+    hist_grow(hist, std::max(from, to));
+    hist->count[from]--;
+    hist->count[to]++;
+    if (to > hist->max) hist->max = to;
+}
+
+// fold a per-thread histogram into the global one and reset it. The global
+// maximum only moves down by the number of values that emptied, so this is
+// O(occupancy range) and never touches the grid.
+static void hist_merge(hist_t *global, hist_t *local){
+    hist_grow(global, local->size);
+    for (int v = 0; v < local->size; v++){
+        global->count[v] += local->count[v];
+        local->count[v] = 0;
+    }
+    global->max = std::max(global->max, local->max);
+    local->max = 0;
+    while (global->max > 0 && global->count[global->max] == 0) global->max--;
+}
+
+// route quality read off the occupancy histogram, which add_cost/clear_cost
+// keep exact, so it costs O(max occupancy) rather than a pass over the grid
+typedef struct {
+    long long occupancy; // sum of all cells, the total length of the routes
+    long long squared;   // sum of the squared cells, the routing cost
+    long long over;      // cells holding more than the congestion threshold
+} quality_t;
+
+static quality_t hist_quality(const hist_t *hist, int threshold){
+    quality_t q = {0, 0, 0};
+    for (int v = 1; v <= hist->max; v++){
+        q.occupancy += (long long)v * hist->count[v];
+        q.squared += (long long)v * v * hist->count[v];
+        if (v > threshold) q.over += hist->count[v];
+    }
+    return q;
+}
+
+// bits of a cell of the given width
+static int cell_bits(cell_width_t width){
+    return (width == CELL_8) ? 8 : (width == CELL_16) ? 16 : 32;
+}
+
+// highest value a cell of the given width may take. Narrow cells keep
+// `headroom` values spare for the updates other threads may have in flight,
+// so an atomic increment that is about to be undone never wraps around.
+static int cell_limit(cell_width_t width, int headroom){
+    if (width == CELL_8) return UINT8_MAX - headroom;
+    if (width == CELL_16) return UINT16_MAX - headroom;
+    return INT32_MAX;
+}
+
+// update one cell of the cost array and record the change in hist; in atomic
+// mode the update is a relaxed atomic so concurrent add_cost/clear_cost calls
+// never lose one. A narrow cell that would leave [0, hist->limit] is put back
+// and hist is marked saturated instead (returns false), the caller then
+// promotes the grid.
+template <typename CELL>
+static inline bool cell_update(CELL *cell, int delta, bool atomic, hist_t *hist){
+    int old;
+    if (atomic){
+        #pragma omp atomic capture
+        { old = *cell; *cell += delta; }
+    } else{
+        old = *cell;
+        *cell += delta;
+    }
+
+    if (sizeof(CELL) < sizeof(cost_t) && (old + delta > hist->limit || old + delta < 0)){
+        if (atomic){
+            #pragma omp atomic
+            *cell -= delta;
         } else{
-            for (x_step = wire.startx; x_step >= wire.endx; x_step--){
-                total_cost += costs[x_step + dim_x * wire.endy];
-            }
+            *cell -= delta;
         }
+        hist->saturated = true;
+        return false;
+    }
+    hist_move(hist, old, old + delta);
+    return true;
+}
+
+// the copy of a cell in the transposed half of a grid, which follows it
+template <typename CELL>
+static inline void shadow_update(CELL *shadow, int delta, bool atomic){
+    if (atomic){
+        #pragma omp atomic
+        *shadow += delta;
+    } else{
+        *shadow += delta;
     }
+}
 
-    if (wire.bend_1){
-        // start to bend 1
-        if (wire.startx == wire.bend_1x){
-            if (wire.starty < wire.bend_1y){
-                for (y_step = wire.starty; y_step < wire.bend_1y; y_step++){
-                    total_cost += costs[wire.startx + dim_x * y_step];
+// update cell (x, y), and its transposed copy if the grid keeps one
+template <typename GRID>
+static inline void grid_update(GRID grid, int x, int y, int delta, bool atomic, hist_t *hist){
+    if (cell_update(&grid.at(x, y), delta, atomic, hist) && GRID::has_columns){
+        shadow_update(grid.column(x, y), delta, atomic);
+    }
+}
+
+// route_walk operation summing the cells; the order does not matter, so
+// every segment is read as the contiguous runs it spans
+template <typename GRID>
+struct route_read_t {
+    GRID grid;
+    int total;
+
+    void row(int x, int y, int dir, int len){
+        int lo = (dir > 0) ? x : x - len + 1;
+        for (int i = 0; i < len; ){
+            int n = grid.run(lo + i, len - i);
+            const typename GRID::cell_t *cells = &grid.at(lo + i, y);
+            for (int j = 0; j < n; j++) total += cells[j];
+            i += n;
+        }
+    }
+    void column(int x, int y, int dir, int len){
+        int lo = (dir > 0) ? y : y - len + 1;
+        if (GRID::has_columns){
+            // contiguous in the transposed copy
+            const typename GRID::cell_t *cells = grid.column(x, lo);
+            for (int j = 0; j < len; j++) total += cells[j];
+        } else{
+            for (int j = 0; j < len; j++) total += grid.at(x, lo + j);
+        }
+    }
+    void cell(int x, int y){ total += grid.at(x, y); }
+};
+
+// route_walk operation adding DELTA to the cells, recording the changes in hist
+template <typename GRID, int DELTA>
+struct route_update_t {
+    GRID grid;
+    bool atomic;
+    hist_t *hist;
+
+    void row(int x, int y, int dir, int len){
+        int lo = (dir > 0) ? x : x - len + 1;
+        for (int i = 0; i < len; ){
+            int n = grid.run(lo + i, len - i);
+            typename GRID::cell_t *cells = &grid.at(lo + i, y);
+            for (int j = 0; j < n; j++){
+                if (cell_update(&cells[j], DELTA, atomic, hist) && GRID::has_columns){
+                    shadow_update(grid.column(lo + i + j, y), DELTA, atomic);
                 }
+            }
+            i += n;
+        }
+    }
+    void column(int x, int y, int dir, int len){
+        int lo = (dir > 0) ? y : y - len + 1;
+        for (int j = 0; j < len; j++) grid_update(grid, x, lo + j, DELTA, atomic, hist);
+    }
+    void cell(int x, int y){ grid_update(grid, x, y, DELTA, atomic, hist); }
+};
+
+// cost of the current route of a wire, read from the grid
+template <typename GRID>
+static int route_cost(wire_t wire, GRID grid){
+    route_read_t<GRID> op = {grid, 0};
+    route_walk(wire, op);
+    return op.total;
+}
+
+// add the route of a wire to the cost array, recording the change in hist
+template <typename GRID>
+static void add_cost(wire_t wire, GRID grid, bool atomic, hist_t *hist){
+    route_update_t<GRID, 1> op = {grid, atomic, hist};
+    route_walk(wire, op);
+}
+
+// clear the costs in the cost array along the existing route
+template <typename GRID>
+static void clear_cost(wire_t wire, GRID grid, bool atomic, hist_t *hist){
+    route_update_t<GRID, -1> op = {grid, atomic, hist};
+    route_walk(wire, op);
+}
+
+// allocate storage for num_wires wires, every route starts out empty
+static void wires_alloc(wires_t *wires, int num_wires){
+    wires->num_wires = num_wires;
+    wires->startx = (coord_t*)calloc(num_wires, sizeof(coord_t));
+    wires->starty = (coord_t*)calloc(num_wires, sizeof(coord_t));
+    wires->endx = (coord_t*)calloc(num_wires, sizeof(coord_t));
+    wires->endy = (coord_t*)calloc(num_wires, sizeof(coord_t));
+    wires->bend = (coord_t*)calloc(num_wires, sizeof(coord_t));
+    wires->vertical_first = (uint8_t*)calloc(num_wires, sizeof(uint8_t));
+}
+
+static void wires_free(wires_t *wires){
+    free(wires->startx);
+    free(wires->starty);
+    free(wires->endx);
+    free(wires->endy);
+    free(wires->bend);
+    free(wires->vertical_first);
+}
+
+// unpack one wire from the store
+static inline wire_t wire_load(const wires_t *wires, int wid){
+    wire_t wire;
+    wire.startx = wires->startx[wid];
+    wire.starty = wires->starty[wid];
+    wire.endx = wires->endx[wid];
+    wire.endy = wires->endy[wid];
+    wire.bend = wires->bend[wid];
+    wire.vertical_first = wires->vertical_first[wid];
+    return wire;
+}
+
+// write back the route of a wire, its endpoints never change
+static inline void wire_store_route(wires_t *wires, int wid, wire_t wire){
+    wires->bend[wid] = (coord_t)wire.bend;
+    wires->vertical_first[wid] = wire.vertical_first;
+}
+
+// write back a whole wire, endpoints included
+static inline void wire_store(wires_t *wires, int wid, wire_t wire){
+    wires->startx[wid] = (coord_t)wire.startx;
+    wires->starty[wid] = (coord_t)wire.starty;
+    wires->endx[wid] = (coord_t)wire.endx;
+    wires->endy[wid] = (coord_t)wire.endy;
+    wire_store_route(wires, wid, wire);
+}
+
+// reorder the store so that wire i is the one that was at from[i]
+static void wires_gather(wires_t *wires, const int *from, int num_threads){
+    wires_t old = *wires;
+    wires_alloc(wires, old.num_wires);
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int i = 0; i < old.num_wires; i++){
+        int f = from[i];
+        wires->startx[i] = old.startx[f];
+        wires->starty[i] = old.starty[f];
+        wires->endx[i] = old.endx[f];
+        wires->endy[i] = old.endy[f];
+        wires->bend[i] = old.bend[f];
+        wires->vertical_first[i] = old.vertical_first[f];
+    }
+    wires_free(&old);
+}
+
+// position of (x, y) along a Hilbert curve through a 2^bits x 2^bits grid
+static uint64_t hilbert_key(uint32_t x, uint32_t y, int bits){
+    uint64_t d = 0;
+    for (uint32_t s = (uint32_t)1 << (bits - 1); s > 0; s >>= 1){
+        uint32_t rx = (x & s) ? 1 : 0, ry = (y & s) ? 1 : 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        // rotate the quadrant so the curve inside it starts and ends right
+        if (ry == 0){
+            if (rx == 1){
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// position of (x, y) along a Z-order curve: the bits of y and x interleaved
+static uint64_t morton_key(uint32_t x, uint32_t y, int bits){
+    uint64_t d = 0;
+    for (int b = bits - 1; b >= 0; b--){
+        d = (d << 2) | (((y >> b) & 1) << 1) | ((x >> b) & 1);
+    }
+    return d;
+}
+
+// sort the wires along a space-filling curve through their bounding-box
+// centers, so wires routed one after the other (by a thread) touch nearby
+// cells. Returns the input index of every wire, for wires_restore.
+static int *wires_order(wires_t *wires, int dim_x, int dim_y, wire_order_t order, int num_threads){
+    int n = wires->num_wires;
+    int bits = 1;
+    while (bits < 32 && ((uint32_t)1 << bits) < (uint32_t)std::max(dim_x, dim_y)) bits++;
+    // keys of up to 32 bits, with the wire index below them to keep ties in input order
+    int shift = std::max(0, 2 * bits - 32);
+
+    uint64_t *keys = (uint64_t*)malloc(n * sizeof(uint64_t));
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int i = 0; i < n; i++){
+        wire_t wire = wire_load(wires, i);
+        uint32_t cx = ((uint32_t)wire.startx + wire.endx) / 2, cy = ((uint32_t)wire.starty + wire.endy) / 2;
+        uint64_t key = (order == ORDER_HILBERT) ? hilbert_key(cx, cy, bits) : morton_key(cx, cy, bits);
+        keys[i] = ((key >> shift) << 32) | (uint32_t)i;
+    }
+    std::sort(keys, keys + n);
+
+    int *from = (int*)malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) from[i] = (int)(uint32_t)keys[i];
+    free(keys);
+    wires_gather(wires, from, num_threads);
+    return from;
+}
+
+// undo wires_order: put every wire back at its input index
+static void wires_restore(wires_t *wires, const int *from, int num_threads){
+    int *to = (int*)malloc(wires->num_wires * sizeof(int));
+    for (int i = 0; i < wires->num_wires; i++) to[from[i]] = i;
+    wires_gather(wires, to, num_threads);
+    free(to);
+}
+
+// per-thread counters of the hot paths, summed over all iterations. Every
+// thread only writes its own, padded so they never share a cache line.
+typedef struct {
+    long long wires;         // wires routed (straight ones are skipped)
+    long long candidates;    // candidate routes scored
+    long long cells_read;    // grid cells read: bbox scans, and route re-reads in atomic mode
+    long long cells_written; // cell updates by clear_cost and add_cost
+    long long improved;      // wires moved to a cheaper route
+    long long randomized;    // wires moved to a random route
+    long long rerouted;      // wires whose route changed, by either
+    double lock_wait;        // seconds waiting to enter a critical section or lock
+    double lock_hold;        // seconds inside them
+    double busy;             // seconds routing, not counting the wait for other threads
+    char pad[64];
+} counters_t;
+
+// one wire routed by this thread: its old route cleared, the new one added
+// (every route of a wire has |dx| + |dy| + 1 cells), and unless another
+// thread helped, its bbox scanned and every candidate scored
+static inline void counters_wire(counters_t *c, wire_t wire, bool scanned, bool improved, bool randomized){
+    int dx = abs(wire.endx - wire.startx), dy = abs(wire.endy - wire.starty);
+    c->wires++;
+    c->cells_written += 2LL * (dx + dy + 1);
+    if (scanned){
+        c->candidates += dx + dy;
+        c->cells_read += (long long)(dx + 1) * (dy + 1);
+    }
+    if (randomized) c->randomized++;
+    else if (improved) c->improved++;
+}
+
+static inline bool route_changed(wire_t from, wire_t to){
+    return from.bend != to.bend || from.vertical_first != to.vertical_first;
+}
+
+// omp_set_lock, with the wait counted; returns when the lock was taken
+static inline double lock_timed(omp_lock_t *lock, counters_t *c){
+    double start = omp_get_wtime();
+    omp_set_lock(lock);
+    double taken = omp_get_wtime();
+    c->lock_wait += taken - start;
+    return taken;
+}
+
+static inline void unlock_timed(omp_lock_t *lock, counters_t *c, double taken){
+    c->lock_hold += omp_get_wtime() - taken;
+    omp_unset_lock(lock);
+}
+
+// estimated work of routing a wire: its bounding box is scanned once, then
+// every candidate is scored. Straight wires are skipped.
+static long long wire_work(wire_t wire){
+    int dx = abs(wire.endx - wire.startx), dy = abs(wire.endy - wire.starty);
+    if (dx == 0 || dy == 0) return 1;
+    return (long long)(dx + 1) * (dy + 1) + dx + dy;
+}
+
+// the wires [head, tail) a thread still has to route in BALANCE_STEAL. The
+// owner takes from the head, thieves take the back half. Padded so two
+// threads' deques never share a cache line.
+typedef struct {
+    int head, tail;
+    omp_lock_t lock;
+    char pad[64];
+} steal_t;
+
+// how route_across hands wires to threads, set up once for all iterations
+typedef struct {
+    balance_t balance;
+    int num_threads;
+    int *order;      // BALANCE_LPT: wire ids, heaviest first
+    int *block;      // BALANCE_STEAL: thread t starts with wires block[t] .. block[t+1]
+    steal_t *deques; // BALANCE_STEAL
+} schedule_t;
+
+static void schedule_init(schedule_t *sched, const wires_t *wires, int num_threads, balance_t balance){
+    int n = wires->num_wires;
+    memset(sched, 0, sizeof(schedule_t));
+    sched->balance = balance;
+    sched->num_threads = num_threads;
+
+    if (balance == BALANCE_LPT){
+        long long *work = (long long*)malloc(n * sizeof(long long));
+        sched->order = (int*)malloc(n * sizeof(int));
+        for (int i = 0; i < n; i++){
+            work[i] = wire_work(wire_load(wires, i));
+            sched->order[i] = i;
+        }
+        std::sort(sched->order, sched->order + n, [&](int a, int b){
+            return work[a] > work[b] || (work[a] == work[b] && a < b);
+        });
+        free(work);
+    } else if (balance == BALANCE_STEAL){
+        // contiguous blocks (so wires stay in their order) of equal estimated work
+        long long total = 0;
+        for (int i = 0; i < n; i++) total += wire_work(wire_load(wires, i));
+        sched->block = (int*)malloc((num_threads + 1) * sizeof(int));
+        sched->deques = (steal_t*)calloc(num_threads, sizeof(steal_t));
+        long long sum = 0;
+        int t = 0;
+        for (int i = 0; i < n; i++){
+            while (t < num_threads && sum >= total * t / num_threads) sched->block[t++] = i;
+            sum += wire_work(wire_load(wires, i));
+        }
+        while (t <= num_threads) sched->block[t++] = n;
+        for (int t = 0; t < num_threads; t++) omp_init_lock(&sched->deques[t].lock);
+    }
+}
+
+static void schedule_free(schedule_t *sched){
+    if (sched->deques){
+        for (int t = 0; t < sched->num_threads; t++) omp_destroy_lock(&sched->deques[t].lock);
+    }
+    free(sched->order);
+    free(sched->block);
+    free(sched->deques);
+}
+
+// next wire for thread t in BALANCE_STEAL, false once no thread has any left.
+// A thief moves the back half of a victim's wires to its own deque, the
+// victim's lock is dropped before the thief's is taken so two threads
+// stealing from each other never deadlock.
+static bool steal_next(schedule_t *sched, int t, int *wid, counters_t *c){
+    steal_t *own = &sched->deques[t];
+    double taken = lock_timed(&own->lock, c);
+    bool found = own->head < own->tail;
+    if (found) *wid = own->head++;
+    unlock_timed(&own->lock, c, taken);
+    if (found) return true;
+
+    for (int v = 1; v < sched->num_threads; v++){
+        steal_t *victim = &sched->deques[(t + v) % sched->num_threads];
+        int lo = 0, hi = 0;
+        taken = lock_timed(&victim->lock, c);
+        int left = victim->tail - victim->head;
+        if (left > 0){
+            hi = victim->tail;
+            lo = hi - (left + 1) / 2;
+            victim->tail = lo;
+        }
+        unlock_timed(&victim->lock, c, taken);
+
+        if (hi > lo){
+            *wid = lo;
+            taken = lock_timed(&own->lock, c);
+            own->head = lo + 1;
+            own->tail = hi;
+            unlock_timed(&own->lock, c, taken);
+            return true;
+        }
+    }
+    return false;
+}
+
+// a straight wire has exactly one route, nothing to improve; and once a cell
+// saturated the grid is rebuilt, stop routing on it
+static inline bool route_skip(wire_t wire, const hist_t *hist){
+    return on_straight_line(wire) || hist->saturated;
+}
+
+// the route a wire moves to once its candidates are scored: with probability
+// prob a random candidate, otherwise best (the current route, which wins ties,
+// when best->k < 0). best->k is set to the candidate taken, and the move is
+// counted in c.
+static inline wire_t route_pick(wire_t cur_wire, candidate_t *best, int wid, uint64_t iteration_seed,
+                                double prob, bool scanned, counters_t *c){
+    rng_t rng = rng_wire(iteration_seed, wid);
+    bool randomized = rng_chance(&rng, prob);
+    if (randomized){
+        //randomly choose one of the candidates
+        best->k = rng_below(&rng, num_routes(cur_wire));
+    }
+    counters_wire(c, cur_wire, scanned, best->k >= 0, randomized);
+
+    // candidates are decoded from their index, only the winner is built
+    wire_t best_route = (best->k < 0) ? cur_wire : make_route(cur_wire, best->k);
+    c->rerouted += route_changed(cur_wire, best_route);
+    return best_route;
+}
+
+// store the new route of a wire and put its cost back on the grid
+template <typename GRID>
+static inline void route_commit(wires_t *wires, int wid, wire_t route, GRID grid, bool atomic, hist_t *hist){
+    wire_store_route(wires, wid, route);
+    add_cost(route, grid, atomic, hist);
+}
+
+// one iteration over all wires, wires split across threads as sched says
+//
+// MODE_ACROSS: every grid update and the bbox snapshot of a wire happen inside
+// one critical section.
+//
+// MODE_ATOMIC: no lock at all. add_cost and clear_cost use relaxed atomic
+// increments, so the cost array is always exact once the loop ends. The bbox
+// snapshot is read without a lock while other threads are moving their wires,
+// so a candidate may be scored against a grid that is already stale when the
+// route is committed. This only affects the quality of a decision, never the
+// correctness of the grid. The staleness is measured by re-reading the chosen
+// route right before add_cost and comparing it with the score it was picked on.
+template <typename GRID>
+static void route_across(wires_t *wires, GRID grid,
+                         int num_wires, int num_threads, uint64_t iteration_seed, double prob,
+                         bool atomic, prefix_t *arenas, hist_t *hists, schedule_t *sched,
+                         counters_t *counters, long long *decisions, long long *stale_decisions, long long *stale_drift){
+    long long decided = 0, stale = 0, drift = 0;
+
+    // PARALLELIZE cross wires (num_wires / num_threads = wires taken care by one thread)
+    // SHARED: grid, wires
+    int WIRES_PER_THREAD = (num_wires + num_threads - 1) / num_threads;
+    if (sched->balance == BALANCE_STEAL){
+        for (int t = 0; t < num_threads; t++){
+            sched->deques[t].head = sched->block[t];
+            sched->deques[t].tail = sched->block[t + 1];
+        }
+    }
+
+    omp_set_num_threads(num_threads);
+    #pragma omp parallel shared(grid, wires) reduction(+: decided, stale, drift)
+    {
+        int t = omp_get_thread_num();
+        prefix_t *prefix = &arenas[t];
+        hist_t *hist = &hists[t];
+        counters_t *c = &counters[t];
+        double start = omp_get_wtime();
+
+        auto route_one = [&](int wid){
+            wire_t cur_wire = wire_load(wires, wid);
+            if (route_skip(cur_wire, hist)) return;
+
+            // clear the current costs and snapshot the bounding box
+            if (atomic){
+                clear_cost(cur_wire, grid, true, hist);
+                prefix_build(prefix, cur_wire, grid);
             } else{
-                for (y_step = wire.starty; y_step > wire.bend_1y; y_step--){
-                    total_cost += costs[wire.startx + dim_x * y_step];
+                double wait_start = omp_get_wtime(), hold_start;
+                #pragma omp critical
+                {
+                    hold_start = omp_get_wtime();
+                    clear_cost(cur_wire, grid, false, hist);
+                    prefix_build(prefix, cur_wire, grid);
+                    c->lock_hold += omp_get_wtime() - hold_start;
                 }
+                c->lock_wait += hold_start - wait_start;
             }
-        } else if (wire.starty == wire.bend_1y){
-            if (wire.startx < wire.bend_1x){
-                for (x_step = wire.startx; x_step < wire.bend_1x; x_step++){
-                    total_cost += costs[x_step + dim_x * wire.starty];
+
+            // the current route is one of the candidates, it wins ties; every
+            // alternative is scored from the prefix sums, no grid access
+            candidate_t best = prefix_best(prefix, cur_wire);
+            wire_t best_route = route_pick(cur_wire, &best, wid, iteration_seed, prob, true, c);
+            int min_cost = prefix_cost(prefix, cur_wire, (best.k < 0) ? route_index(cur_wire) : best.k);
+
+            if (atomic){
+                int actual_cost = route_cost(best_route, grid);
+                c->cells_read += num_routes(cur_wire) + 1;
+                decided++;
+                if (actual_cost != min_cost){
+                    stale++;
+                    drift += abs(actual_cost - min_cost);
                 }
+                route_commit(wires, wid, best_route, grid, true, hist);
             } else{
-                for (x_step = wire.startx; x_step > wire.bend_1x; x_step--){
-                    total_cost += costs[x_step + dim_x * wire.starty];
+                double wait_start = omp_get_wtime(), hold_start;
+                #pragma omp critical
+                {
+                    hold_start = omp_get_wtime();
+                    route_commit(wires, wid, best_route, grid, false, hist);
+                    c->lock_hold += omp_get_wtime() - hold_start;
                 }
+                c->lock_wait += hold_start - wait_start;
+            }
+        };
+
+        // the time a thread waits at the end for the others is not busy time
+        if (sched->balance == BALANCE_LPT){
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (int i = 0; i < num_wires; i++){
+                route_one(sched->order[i]);
+            }
+        } else if (sched->balance == BALANCE_STEAL){
+            int wid;
+            while (steal_next(sched, t, &wid, c)){
+                route_one(wid);
+            }
+        } else{
+            #pragma omp for schedule(static, WIRES_PER_THREAD) nowait
+            for (int wid = 0; wid < num_wires; wid++){
+                route_one(wid);
             }
         }
+        c->busy += omp_get_wtime() - start;
+    }
 
-        if (wire.bend_2){
-            // bend 1 to bend 2
-            if (wire.bend_2x == wire.bend_1x){
-                // vertical bend 1 to bend 2
-                if (wire.bend_1y < wire.bend_1y){
-                    for (y_step = wire.starty; y_step < wire.bend_1y; y_step++){
-                        total_cost += costs[wire.startx + dim_x * y_step];
-                    }
-                } else{
-                    for (y_step = wire.starty; y_step > wire.bend_1y; y_step--){
-                        total_cost += costs[wire.startx + dim_x * y_step];
-                    }
+    *decisions += decided;
+    *stale_decisions += stale;
+    *stale_drift += drift;
+}
+
+// wires whose bounding box has fewer cells than this are routed by one thread
+// in MODE_WITHIN, splitting them costs more in barriers than it saves
+#define WITHIN_MIN_AREA 4096
+
+// one iteration over all wires, the wires are visited in order and the work of
+// each wire (bbox scan and candidate scoring) is split across threads. The best
+// candidate is found with a min-reduction over (cost, candidate index), so the
+// result does not depend on the number of threads.
+template <typename GRID>
+static void route_within(wires_t *wires, GRID grid,
+                         int num_wires, int num_threads, uint64_t iteration_seed, double prob,
+                         prefix_t *prefix, hist_t *hist, counters_t *counters){
+    candidate_t best;
+    bool saturated = false;
+
+    omp_set_num_threads(num_threads);
+    #pragma omp parallel shared(grid, wires, prefix, best, hist, saturated)
+    {
+        int nthreads = omp_get_num_threads();
+        counters_t *c = &counters[omp_get_thread_num()];
+        double start = omp_get_wtime();
+
+        // saturated is only written by the last single of a wire, so every
+        // thread reads the same value here; once a cell saturated the grid is
+        // rebuilt, stop routing on it
+        for (int wid = 0; wid < num_wires && !saturated; wid++){
+            wire_t cur_wire = wire_load(wires, wid);
+            if (route_skip(cur_wire, hist)) continue;
+
+            int total_routes = num_routes(cur_wire);
+            int w = abs(cur_wire.endx - cur_wire.startx) + 1;
+            int h = abs(cur_wire.endy - cur_wire.starty) + 1;
+            bool split = w * h >= WITHIN_MIN_AREA;
+
+            if (!split){
+                #pragma omp single
+                {
+                    clear_cost(cur_wire, grid, false, hist);
+                    prefix_build(prefix, cur_wire, grid);
+                    best = prefix_best(prefix, cur_wire);
                 }
-            } else if (wire.bend_2y == wire.bend_1y){
-                if (wire.bend_1x < wire.bend_2x){
-                    for (x_step = wire.bend_1x; x_step < wire.bend_2x; x_step++){
-                        total_cost += costs[wire.startx + dim_x * y_step];
-                    }
-                } else{
-                    for (x_step = wire.bend_1x; x_step > wire.bend_2x; x_step--){
-                        total_cost += costs[wire.startx + dim_x * y_step];
-                    }
+            } else{
+                #pragma omp single
+                {
+                    clear_cost(cur_wire, grid, false, hist);
+                    prefix_reserve(prefix, w, h);
                 }
-            }
 
-            // bend 2 to end
-            if (wire.endx == wire.bend_2x){
-                // vertical from bend 2 to end
-                if (wire.bend_2y < wire.endy){
-                    for (y_step = wire.bend_2y; y_step <= wire.endy; y_step++){
-                        total_cost += costs[wire.endx + dim_x * y_step];
-                    }
-                } else{
-                    for (y_step = wire.bend_2y; y_step >= wire.endy; y_step--){
-                        total_cost += costs[wire.endx + dim_x * y_step];
-                    }
+                #pragma omp for schedule(static)
+                for (int y = 0; y < h; y++){
+                    prefix_scan_rows(prefix, cur_wire, grid, y, y + 1, false);
+                    c->cells_read += w;
                 }
-            } else if (wire.endy == wire.bend_2y){
-                // horizontal from bend 2 to end
-                if (wire.bend_2x < wire.endx){
-                    for (x_step = wire.bend_2x; x_step <= wire.endx; x_step++){
-                        total_cost += costs[x_step + dim_x * wire.endy];
-                    }
-                } else{
-                    for (x_step = wire.bend_2x; x_step >= wire.endx; x_step--){
-                        total_cost += costs[x_step + dim_x * wire.endy];
-                    }
+
+                // columns in one contiguous block per thread so rows are still walked in order
+                #pragma omp for schedule(static)
+                for (int t = 0; t < nthreads; t++){
+                    int x_lo = (int)((long long)w * t / nthreads), x_hi = (int)((long long)w * (t + 1) / nthreads);
+                    prefix_scan_cols(prefix, cur_wire, grid, x_lo, x_hi);
+                    c->cells_read += (long long)h * (x_hi - x_lo);
+                }
+
+                #pragma omp single
+                {
+                    prefix_finish(prefix, cur_wire);
+                    best.cost = prefix_score(prefix, cur_wire, route_index(cur_wire));
+                    best.k = -1;
+                }
+
+                #pragma omp for schedule(static) reduction(min_cand: best)
+                for (int k = 0; k < total_routes; k++){
+                    candidate_t cand = {prefix_score(prefix, cur_wire, k), k};
+                    best = min_candidate(best, cand);
+                    c->candidates++;
                 }
             }
-        } else{
-            // only 1 bend
-            if (wire.endx == wire.bend_1x){
-                // vertical from bend 1 to end
-                if (wire.bend_1y < wire.endy){
-                    for (y_step = wire.bend_1y; y_step <= wire.endy; y_step++){
-                        total_cost += costs[wire.endx + dim_x * y_step];
-                    }
-                } else{
-                    for (y_step = wire.bend_1y; y_step >= wire.endy; y_step--){
-                        total_cost += costs[wire.endx + dim_x * y_step];
+
+            #pragma omp single
+            {
+                wire_t best_route = route_pick(cur_wire, &best, wid, iteration_seed, prob, !split, c);
+                route_commit(wires, wid, best_route, grid, false, hist);
+                saturated = hist->saturated;
+            }
+        }
+        c->busy += omp_get_wtime() - start;
+    }
+}
+
+// route one wire against the grid with no synchronization at all: the caller
+// guarantees nobody else touches the wire's bounding box meanwhile
+template <typename GRID>
+static void route_wire(wires_t *wires, int wid, GRID grid,
+                       uint64_t iteration_seed, double prob, prefix_t *prefix, hist_t *hist,
+                       counters_t *c){
+    wire_t cur_wire = wire_load(wires, wid);
+    if (route_skip(cur_wire, hist)) return;
+
+    clear_cost(cur_wire, grid, false, hist);
+    prefix_build(prefix, cur_wire, grid);
+
+    candidate_t best = prefix_best(prefix, cur_wire);
+    wire_t best_route = route_pick(cur_wire, &best, wid, iteration_seed, prob, true, c);
+    route_commit(wires, wid, best_route, grid, false, hist);
+}
+
+// wires grouped into batches (colors) whose bounding boxes never overlap
+typedef struct {
+    int num_colors;
+    int *order;  // wire ids grouped by color
+    int *start;  // color c is order[start[c] .. start[c+1])
+} coloring_t;
+
+// side of the square bins used to find overlapping bounding boxes
+#define COLOR_BIN 64
+// cost of the barrier closing a batch in wire_work units, at about 0.4 ns a
+// unit: roughly half a microsecond
+#define COLOR_BARRIER_WORK 1024
+
+static inline bool bbox_overlap(wire_t a, wire_t b){
+    return std::max(a.startx, a.endx) >= std::min(b.startx, b.endx) &&
+           std::max(b.startx, b.endx) >= std::min(a.startx, a.endx) &&
+           std::max(a.starty, a.endy) >= std::min(b.starty, b.endy) &&
+           std::max(b.starty, b.endy) >= std::min(a.starty, a.endy);
+}
+
+static inline void bbox_bins(wire_t wire, int *bx0, int *by0, int *bx1, int *by1){
+    *bx0 = std::min(wire.startx, wire.endx) / COLOR_BIN;
+    *bx1 = std::max(wire.startx, wire.endx) / COLOR_BIN;
+    *by0 = std::min(wire.starty, wire.endy) / COLOR_BIN;
+    *by1 = std::max(wire.starty, wire.endy) / COLOR_BIN;
+}
+
+// greedy coloring of the bounding-box conflict graph. Wires only ever touch
+// cells inside their bounding box, so wires of one color can be routed fully in
+// parallel. Wires are colored heaviest first (by wire_work), which keeps the
+// big, much overlapped boxes from each opening a color of their own late, and
+// lists every batch heaviest first for its dynamic schedule. Overlaps are
+// found through a coarse bin grid; the graph is never stored.
+//
+// Returns false (and frees everything) when coloring would cost more than an
+// iteration of routing, or when the batches hold too little parallel work to
+// beat routing the wires one at a time: a batch takes at least as long as its
+// heaviest wire plus its barrier, so the total work over the sum of those is
+// the most any number of threads can gain. Neither test depends on the number
+// of threads, so for one input the mode (and so the routes) never changes
+// with -n. The caller should then fall back to another mode.
+static bool color_wires(const wires_t *wires, int num_wires, int dim_x, int dim_y,
+                        coloring_t *coloring){
+    int bins_x = (dim_x + COLOR_BIN - 1) / COLOR_BIN;
+    int bins_y = (dim_y + COLOR_BIN - 1) / COLOR_BIN;
+    int num_bins = bins_x * bins_y;
+
+    // wires by rank, heaviest first (ties in input order)
+    long long *work = (long long*)malloc(std::max(num_wires, 1) * sizeof(long long));
+    int *ranked = (int*)malloc(std::max(num_wires, 1) * sizeof(int));
+    long long total_work = 0;
+    for (int wid = 0; wid < num_wires; wid++){
+        work[wid] = wire_work(wire_load(wires, wid));
+        total_work += work[wid];
+        ranked[wid] = wid;
+    }
+    std::sort(ranked, ranked + num_wires, [&](int a, int b){
+        return work[a] > work[b] || (work[a] == work[b] && a < b);
+    });
+
+    // bin -> ranks of the wires whose bbox covers it, in CSR form
+    int *bin_start = (int*)calloc(num_bins + 1, sizeof(int));
+    for (int wid = 0; wid < num_wires; wid++){
+        int bx0, by0, bx1, by1;
+        bbox_bins(wire_load(wires, wid), &bx0, &by0, &bx1, &by1);
+        for (int by = by0; by <= by1; by++)
+            for (int bx = bx0; bx <= bx1; bx++)
+                bin_start[bx + bins_x * by + 1]++;
+    }
+    for (int b = 0; b < num_bins; b++) bin_start[b + 1] += bin_start[b];
+
+    int *bin_fill = (int*)malloc(num_bins * sizeof(int));
+    memcpy(bin_fill, bin_start, num_bins * sizeof(int));
+    int *bin_wires = (int*)malloc(std::max(bin_start[num_bins], 1) * sizeof(int));
+    for (int r = 0; r < num_wires; r++){
+        int bx0, by0, bx1, by1;
+        bbox_bins(wire_load(wires, ranked[r]), &bx0, &by0, &bx1, &by1);
+        for (int by = by0; by <= by1; by++)
+            for (int bx = bx0; bx <= bx1; bx++)
+                bin_wires[bin_fill[bx + bins_x * by]++] = r;
+    }
+    free(bin_fill);
+
+    int *color = (int*)malloc(std::max(num_wires, 1) * sizeof(int));      // by rank
+    int *seen = (int*)malloc(std::max(num_wires, 1) * sizeof(int));       // last rank that visited a neighbour
+    int *color_used = (int*)malloc((num_wires + 1) * sizeof(int));        // last rank that saw a color
+    long long *color_max = (long long*)calloc(num_wires + 1, sizeof(long long)); // heaviest wire of a color
+    for (int i = 0; i < num_wires; i++){
+        seen[i] = -1;
+        color_used[i] = -1;
+    }
+    color_used[num_wires] = -1;
+
+    // every overlap test costs about as much as routing a cell
+    long long edges = 0, tests = 0;
+    int num_colors = 0;
+    bool too_costly = false;
+
+    for (int r = 0; r < num_wires && !too_costly; r++){
+        wire_t wire = wire_load(wires, ranked[r]);
+        int bx0, by0, bx1, by1;
+        bbox_bins(wire, &bx0, &by0, &bx1, &by1);
+
+        // mark the colors of all heavier wires that overlap this one
+        for (int by = by0; by <= by1; by++){
+            for (int bx = bx0; bx <= bx1; bx++){
+                int b = bx + bins_x * by;
+                for (int j = bin_start[b]; j < bin_start[b + 1]; j++){
+                    int other = bin_wires[j];
+                    if (other >= r) break;  // bins list wires in increasing rank
+                    if (seen[other] == r) continue;
+                    seen[other] = r;
+                    tests++;
+                    if (bbox_overlap(wire, wire_load(wires, ranked[other]))){
+                        color_used[color[other]] = r;
+                        edges++;
                     }
                 }
-            } else if (wire.endy == wire.bend_1y){
-                // horizontal from bend 1 to end
-                if (wire.bend_1x < wire.endx){
-                    for (x_step = wire.bend_1x; x_step <= wire.endx; x_step++){
-                        total_cost += costs[x_step + dim_x * wire.endy];
-                    }
-                } else{
-                    for (x_step = wire.bend_1x; x_step >= wire.endx; x_step--){
-                        total_cost += costs[x_step + dim_x * wire.endy];
-                    }
+            }
+        }
+        if (tests > total_work) too_costly = true;
+
+        int c = 0;
+        while (color_used[c] == r) c++;
+        color[r] = c;
+        // ranks are heaviest first, so the first wire of a color is its heaviest
+        if (color_max[c] == 0) color_max[c] = work[ranked[r]];
+        num_colors = std::max(num_colors, c + 1);
+    }
+
+    free(bin_start);
+    free(bin_wires);
+    free(seen);
+    free(color_used);
+    free(work);
+
+    double speedup = 0;
+    if (!too_costly){
+        long long critical = 0;
+        for (int c = 0; c < num_colors; c++) critical += color_max[c] + COLOR_BARRIER_WORK;
+        speedup = (double)total_work / std::max(critical, 1LL);
+    }
+    free(color_max);
+
+    if (too_costly){
+        free(color);
+        free(ranked);
+        printf("Conflict graph: more overlap tests than one routing iteration of work.\n");
+        return false;
+    }
+    if (speedup <= 1.0){
+        free(color);
+        free(ranked);
+        printf("Conflict graph: %d wire batches, at most %.2fx the speed of routing wire by wire.\n",
+               num_colors, speedup);
+        return false;
+    }
+
+    // bucket the wires by color, heaviest first inside a color
+    coloring->num_colors = num_colors;
+    coloring->start = (int*)calloc(num_colors + 1, sizeof(int));
+    coloring->order = (int*)malloc(std::max(num_wires, 1) * sizeof(int));
+    for (int r = 0; r < num_wires; r++) coloring->start[color[r] + 1]++;
+    for (int c = 0; c < num_colors; c++) coloring->start[c + 1] += coloring->start[c];
+    int *fill = (int*)malloc(std::max(num_colors, 1) * sizeof(int));
+    memcpy(fill, coloring->start, num_colors * sizeof(int));
+    for (int r = 0; r < num_wires; r++) coloring->order[fill[color[r]]++] = ranked[r];
+    free(fill);
+    free(color);
+    free(ranked);
+
+    printf("Conflict graph: %lld overlaps, %d wire batches, %.1f wires per batch, at most %.2fx speedup.\n",
+           edges, num_colors, (double)num_wires / std::max(num_colors, 1), speedup);
+    return true;
+}
+
+// one iteration over all wires, batch by batch. Wires of a batch are routed in
+// parallel with no lock since their bounding boxes are disjoint, so the result
+// is the same as routing the batch serially.
+template <typename GRID>
+static void route_colored(wires_t *wires, GRID grid,
+                          int num_threads, uint64_t iteration_seed, double prob,
+                          const coloring_t *coloring, prefix_t *arenas, hist_t *hists,
+                          counters_t *counters){
+    omp_set_num_threads(num_threads);
+    #pragma omp parallel shared(grid, wires)
+    {
+        prefix_t *prefix = &arenas[omp_get_thread_num()];
+        hist_t *hist = &hists[omp_get_thread_num()];
+        counters_t *counter = &counters[omp_get_thread_num()];
+        double start = omp_get_wtime();
+
+        for (int c = 0; c < coloring->num_colors; c++){
+            #pragma omp for schedule(dynamic, 1) nowait
+            for (int j = coloring->start[c]; j < coloring->start[c + 1]; j++){
+                route_wire(wires, coloring->order[j], grid, iteration_seed, prob, prefix, hist, counter);
+            }
+            // the batch barrier, timed apart so busy time leaves it out
+            double wait_start = omp_get_wtime();
+            counter->busy += wait_start - start;
+            #pragma omp barrier
+            start = omp_get_wtime();
+        }
+    }
+}
+
+// the grid split into strips along one axis, one per thread. A wire whose
+// bounding box lies in one strip is owned by it: its routes never leave the
+// box, so the owner routes it without any synchronization. Wires crossing
+// strips are routed afterwards holding the locks of every strip they span.
+typedef struct {
+    int num_strips;
+    bool vertical;     // strips of columns (cut along x), else of rows
+    int *bound;        // strip s is [bound[s], bound[s + 1]) along the cut axis
+    int *order;        // wire ids grouped by owning strip, then the crossing ones
+    int *start;        // strip s owns order[start[s] .. start[s + 1]), the
+                       // crossing wires are order[start[num_strips] .. num_wires)
+    omp_lock_t *locks; // one per strip, only taken by the crossing phase
+} regions_t;
+
+// the extent of a wire's bounding box along the cut axis
+static inline void region_extent(wire_t wire, bool vertical, int *lo, int *hi){
+    int a = vertical ? wire.startx : wire.starty, b = vertical ? wire.endx : wire.endy;
+    *lo = std::min(a, b);
+    *hi = std::max(a, b);
+}
+
+// the strip holding coordinate v
+static inline int region_strip(const int *bound, int num_strips, int v){
+    return (int)(std::upper_bound(bound + 1, bound + num_strips, v) - (bound + 1));
+}
+
+// cut an axis of length dim into num_strips strips of about equal work, the
+// work of a wire counting at the center of its bbox so dense areas get
+// narrow strips. Each cut then moves, within a window of a quarter strip, to
+// where the crossing wires carry the least work. Returns that crossing work.
+static long long region_cuts(const wires_t *wires, bool vertical, int dim, int num_strips, int *bound){
+    long long *load = (long long*)calloc(dim + 1, sizeof(long long));
+    long long *cross = (long long*)calloc(dim + 2, sizeof(long long));
+    for (int wid = 0; wid < wires->num_wires; wid++){
+        wire_t wire = wire_load(wires, wid);
+        int lo, hi;
+        region_extent(wire, vertical, &lo, &hi);
+        long long work = wire_work(wire);
+        load[(lo + hi) / 2 + 1] += work;
+        // a cut at p separates p - 1 from p, which splits the wire if lo < p <= hi
+        cross[lo + 1] += work;
+        cross[hi + 1] -= work;
+    }
+    for (int p = 1; p <= dim; p++){
+        load[p] += load[p - 1];  // work of the wires centered before p
+        cross[p] += cross[p - 1];
+    }
+
+    bound[0] = 0;
+    bound[num_strips] = dim;
+    int window = std::max(1, dim / (4 * num_strips));
+    long long crossing = 0;
+    for (int s = 1; s < num_strips; s++){
+        long long target = load[dim] * s / num_strips;
+        int center = (int)(std::lower_bound(load, load + dim + 1, target) - load);
+        int from = std::max(bound[s - 1] + 1, center - window);
+        int to = std::max(from, std::min(dim - (num_strips - s), center + window));
+        int best = from;
+        for (int p = from; p <= to; p++){
+            if (cross[p] < cross[best] || (cross[p] == cross[best] && abs(p - center) < abs(best - center))) best = p;
+        }
+        bound[s] = best;
+        crossing += cross[best];
+    }
+    free(load);
+    free(cross);
+    return crossing;
+}
+
+// split the grid along whichever axis the crossing wires carry less work on
+// and group the wires by owning strip, keeping their order within a strip
+static void regions_build(const wires_t *wires, int dim_x, int dim_y, int num_threads, regions_t *regions){
+    int num_strips = std::max(1, std::min(num_threads, std::min(dim_x, dim_y)));
+    int *bound_x = (int*)malloc((num_strips + 1) * sizeof(int));
+    int *bound_y = (int*)malloc((num_strips + 1) * sizeof(int));
+    long long cross_x = region_cuts(wires, true, dim_x, num_strips, bound_x);
+    long long cross_y = region_cuts(wires, false, dim_y, num_strips, bound_y);
+
+    regions->num_strips = num_strips;
+    regions->vertical = (cross_x <= cross_y);
+    regions->bound = regions->vertical ? bound_x : bound_y;
+    free(regions->vertical ? bound_y : bound_x);
+
+    // owning strip of every wire, num_strips for the crossing ones
+    int num_wires = wires->num_wires;
+    int *owner = (int*)malloc(std::max(num_wires, 1) * sizeof(int));
+    regions->start = (int*)calloc(num_strips + 2, sizeof(int));
+    long long owned_work = 0, crossing_work = 0;
+    for (int wid = 0; wid < num_wires; wid++){
+        wire_t wire = wire_load(wires, wid);
+        int lo, hi;
+        region_extent(wire, regions->vertical, &lo, &hi);
+        int s = region_strip(regions->bound, num_strips, lo);
+        owner[wid] = (s == region_strip(regions->bound, num_strips, hi)) ? s : num_strips;
+        regions->start[owner[wid] + 1]++;
+        (owner[wid] < num_strips ? owned_work : crossing_work) += wire_work(wire);
+    }
+    for (int s = 0; s <= num_strips; s++) regions->start[s + 1] += regions->start[s];
+
+    int *fill = (int*)malloc((num_strips + 1) * sizeof(int));
+    memcpy(fill, regions->start, (num_strips + 1) * sizeof(int));
+    regions->order = (int*)malloc(std::max(num_wires, 1) * sizeof(int));
+    for (int wid = 0; wid < num_wires; wid++){
+        regions->order[fill[owner[wid]]++] = wid;
+    }
+    free(fill);
+    free(owner);
+
+    regions->locks = (omp_lock_t*)malloc(num_strips * sizeof(omp_lock_t));
+    for (int s = 0; s < num_strips; s++) omp_init_lock(&regions->locks[s]);
+
+    int crossing = num_wires - regions->start[num_strips];
+    long long total_work = owned_work + crossing_work;
+    printf("Regions: %d %s strips, %d wires owned, %d crossing (%.1f%% of the work).\n",
+           num_strips, regions->vertical ? "vertical" : "horizontal", num_wires - crossing, crossing,
+           total_work ? 100.0 * crossing_work / total_work : 0.0);
+}
+
+static void regions_free(regions_t *regions){
+    for (int s = 0; s < regions->num_strips; s++) omp_destroy_lock(&regions->locks[s]);
+    free(regions->locks);
+    free(regions->bound);
+    free(regions->order);
+    free(regions->start);
+}
+
+template <typename GRID>
+static void route_regions(wires_t *wires, GRID grid,
+                          int num_threads, uint64_t iteration_seed, double prob,
+                          const regions_t *regions, prefix_t *arenas, hist_t *hists,
+                          counters_t *counters){
+    int num_strips = regions->num_strips, num_wires = wires->num_wires;
+    omp_set_num_threads(num_threads);
+    #pragma omp parallel shared(grid, wires)
+    {
+        prefix_t *prefix = &arenas[omp_get_thread_num()];
+        hist_t *hist = &hists[omp_get_thread_num()];
+        counters_t *c = &counters[omp_get_thread_num()];
+        double start = omp_get_wtime();
+
+        // owned wires, every strip by one thread and without locks
+        #pragma omp for schedule(static, 1) nowait
+        for (int s = 0; s < num_strips; s++){
+            for (int j = regions->start[s]; j < regions->start[s + 1]; j++){
+                route_wire(wires, regions->order[j], grid, iteration_seed, prob, prefix, hist, c);
+            }
+        }
+        c->busy += omp_get_wtime() - start;
+        #pragma omp barrier
+        start = omp_get_wtime();
+
+        // crossing wires, holding the locks of the strips they span; taken in
+        // strip order, so no two wires ever wait on each other
+        #pragma omp for schedule(dynamic, 1) nowait
+        for (int j = regions->start[num_strips]; j < num_wires; j++){
+            int wid = regions->order[j];
+            int lo, hi;
+            region_extent(wire_load(wires, wid), regions->vertical, &lo, &hi);
+            int first = region_strip(regions->bound, num_strips, lo);
+            int last = region_strip(regions->bound, num_strips, hi);
+
+            double wait_start = omp_get_wtime();
+            for (int s = first; s <= last; s++) omp_set_lock(&regions->locks[s]);
+            double hold_start = omp_get_wtime();
+            c->lock_wait += hold_start - wait_start;
+
+            route_wire(wires, wid, grid, iteration_seed, prob, prefix, hist, c);
+
+            for (int s = first; s <= last; s++) omp_unset_lock(&regions->locks[s]);
+            c->lock_hold += omp_get_wtime() - hold_start;
+        }
+        c->busy += omp_get_wtime() - start;
+    }
+}
+
+// simulated annealing schedule: the probability of taking a random route in
+// iteration i is prob * decay^i, and routing stops after max_iters iterations
+// or as soon as one improves the total cost (under OBJECTIVE_MAX the max
+// occupancy, when it changed) by less than min_gain (relative). An iteration
+// the random moves made worse is no sign of convergence, routing goes on
+// after it.
+typedef struct {
+    int max_iters;
+    double prob;
+    double decay;
+    double min_gain;
+} anneal_t;
+
+// one routing iteration over a typed grid view
+template <typename GRID>
+static void route_iteration(wires_t *wires, GRID grid, int num_wires,
+                            int num_threads, route_mode_t mode, uint64_t iteration_seed, double prob,
+                            const coloring_t *coloring, const regions_t *regions,
+                            prefix_t *arenas, hist_t *hists, schedule_t *sched, counters_t *counters,
+                            long long *decisions, long long *stale_decisions, long long *stale_drift){
+    if (mode == MODE_COLOR){
+        route_colored(wires, grid, num_threads, iteration_seed, prob, coloring, arenas, hists, counters);
+    } else if (mode == MODE_REGION){
+        route_regions(wires, grid, num_threads, iteration_seed, prob, regions, arenas, hists, counters);
+    } else if (mode == MODE_WITHIN){
+        route_within(wires, grid, num_wires, num_threads, iteration_seed, prob,
+                     &arenas[0], &hists[0], counters);
+    } else{
+        route_across(wires, grid, num_wires, num_threads, iteration_seed, prob,
+                     mode == MODE_ATOMIC, arenas, hists, sched, counters,
+                     decisions, stale_decisions, stale_drift);
+    }
+}
+
+// route_walk operation adding a route to the rows [y_lo, y_hi) of the grid
+// only, so threads that own different row bands never touch the same cell
+template <typename GRID>
+struct route_band_t {
+    route_update_t<GRID, 1> update;
+    int y_lo;
+    int y_hi;
+
+    void row(int x, int y, int dir, int len){
+        if (y >= y_lo && y < y_hi) update.row(x, y, dir, len);
+    }
+    void column(int x, int y, int dir, int len){
+        int lo = (dir > 0) ? y : y - len + 1;
+        int from = std::max(lo, y_lo), to = std::min(lo + len, y_hi);
+        if (from < to) update.column(x, from, 1, to - from);
+    }
+    void cell(int x, int y){
+        if (y >= y_lo && y < y_hi) update.cell(x, y);
+    }
+};
+
+// cells allocated for a grid, tiles are padded to whole tiles and the dual
+// layout holds the grid twice
+static size_t grid_num_cells(grid_layout_t layout, int dim_x, int dim_y){
+    if (layout == LAYOUT_TILES){
+        size_t tiles_x = (dim_x + GRID_TILE - 1) / GRID_TILE, tiles_y = (dim_y + GRID_TILE - 1) / GRID_TILE;
+        return tiles_x * tiles_y * GRID_TILE * GRID_TILE;
+    }
+    if (layout == LAYOUT_DUAL) return 2 * (size_t)dim_x * dim_y;
+    return (size_t)dim_x * dim_y;
+}
+
+// zero the cells of band b of num_bands (rows [y_lo, y_hi), whole tile rows),
+// so that the thread placing the band is the first to touch its pages. The
+// row-major part of every layout is split by rows, the last band taking the
+// padding of a tiled grid; the transposed half of the dual layout in equal
+// slices.
+static void grid_zero_band(const grid_t *grid, int dim_x, int dim_y, int b, int num_bands, int y_lo, int y_hi){
+    size_t cell_size = cell_bits(grid->width) / 8;
+    size_t row_cells = (grid->layout == LAYOUT_TILES) ? (size_t)(dim_x + GRID_TILE - 1) / GRID_TILE * GRID_TILE
+                                                       : (size_t)dim_x;
+    size_t rows_end = (grid->layout == LAYOUT_DUAL) ? (size_t)dim_x * dim_y
+                                                    : grid_num_cells(grid->layout, dim_x, dim_y);
+    size_t lo = row_cells * y_lo, hi = (b == num_bands - 1) ? rows_end : row_cells * y_hi;
+    char *cells = (char*)grid->cells;
+    memset(cells + lo * cell_size, 0, (hi - lo) * cell_size);
+
+    if (grid->layout == LAYOUT_DUAL){
+        size_t half = (size_t)dim_x * dim_y;
+        lo = half + half * b / num_bands;
+        hi = half + half * (b + 1) / num_bands;
+        memset(cells + lo * cell_size, 0, (hi - lo) * cell_size);
+    }
+}
+
+// the rows a route spans
+static inline void route_rows(const wires_t *wires, int wid, int *y_min, int *y_max){
+    int sy = wires->starty[wid], ey = wires->endy[wid];
+    *y_min = std::min(sy, ey);
+    *y_max = std::max(sy, ey);
+    if (wires->vertical_first[wid]){
+        *y_min = std::min(*y_min, (int)wires->bend[wid]);
+        *y_max = std::max(*y_max, (int)wires->bend[wid]);
+    }
+}
+
+// place every wire on the grid, false if a cell saturated. The rows are split
+// into bands of whole tiles, a few per thread and dealt out round robin since
+// wires cluster; each thread zeroes its bands, then (the same static schedule
+// handing it the same bands) adds the part of every route that falls into
+// them, so no cell is shared and the result does not depend on the number of
+// threads. The transposed half of a dual grid is zeroed in slices that other
+// bands write to, hence the barrier between the two.
+template <typename GRID>
+static bool grid_place(const grid_t *grid_info, const wires_t *wires, GRID grid, int dim_x, int dim_y,
+                       int limit, int num_threads){
+    int tile_rows = (dim_y + GRID_TILE - 1) / GRID_TILE;
+    int num_bands = std::max(1, std::min(tile_rows, 4 * num_threads));
+    bool saturated = false;
+
+    #pragma omp parallel num_threads(num_threads) reduction(||: saturated)
+    {
+        hist_t hist = {0, NULL, 0, limit, false};
+
+        #pragma omp for schedule(static, 1)
+        for (int b = 0; b < num_bands; b++){
+            int y_lo = std::min(dim_y, (int)((long long)tile_rows * b / num_bands) * GRID_TILE);
+            int y_hi = std::min(dim_y, (int)((long long)tile_rows * (b + 1) / num_bands) * GRID_TILE);
+            grid_zero_band(grid_info, dim_x, dim_y, b, num_bands, y_lo, y_hi);
+        }
+
+        #pragma omp for schedule(static, 1)
+        for (int b = 0; b < num_bands; b++){
+            int y_lo = std::min(dim_y, (int)((long long)tile_rows * b / num_bands) * GRID_TILE);
+            int y_hi = std::min(dim_y, (int)((long long)tile_rows * (b + 1) / num_bands) * GRID_TILE);
+            route_band_t<GRID> op = {{grid, false, &hist}, y_lo, y_hi};
+            for (int i = 0; i < wires->num_wires && !hist.saturated; i++){
+                int y_min, y_max;
+                route_rows(wires, i, &y_min, &y_max);
+                if (y_max < y_lo || y_min >= y_hi) continue;
+                route_walk(wire_load(wires, i), op);
+            }
+        }
+        saturated = hist.saturated;
+        free(hist.count);
+    }
+    return !saturated;
+}
+
+// allocate the grid at grid->width and place every wire on it, widening the
+// cells until no cell saturates
+static void grid_build(grid_t *grid, const wires_t *wires, int dim_x, int dim_y, int num_threads){
+    size_t num_cells = grid_num_cells(grid->layout, dim_x, dim_y);
+    for (;;){
+        int limit = cell_limit(grid->width, 0);
+        bool placed = false;
+        // zeroed by grid_place, band by band
+        grid->cells = malloc(num_cells * (cell_bits(grid->width) / 8));
+        GRID_VISIT(grid, dim_x, dim_y, placed = grid_place(grid, wires, view, dim_x, dim_y, limit, num_threads));
+        if (placed) return;
+
+        free(grid->cells);
+        grid->width = (cell_width_t)(grid->width + 1);
+        printf("Cell saturated, widening the grid to %d-bit cells.\n", cell_bits(grid->width));
+    }
+}
+
+template <typename CELL>
+static void hist_fill(hist_t *hist, const CELL *costs, size_t num_cells){
+    for (size_t i = 0; i < num_cells; i++){
+        hist_grow(hist, costs[i]);
+        hist->count[costs[i]]++;
+        hist->max = std::max(hist->max, (int)costs[i]);
+    }
+}
+
+// histogram of the whole grid; the padding of a tiled grid only adds empty
+// cells, which never count towards the cost, and the transposed copy of the
+// dual layout is skipped
+static void grid_histogram(const grid_t *grid, int dim_x, int dim_y, hist_t *hist){
+    size_t num_cells = (grid->layout == LAYOUT_DUAL) ? (size_t)dim_x * dim_y
+                                                     : grid_num_cells(grid->layout, dim_x, dim_y);
+    hist->max = 0;
+    if (hist->count) memset(hist->count, 0, hist->size * sizeof(long long));
+    GRID_VISIT(grid, dim_x, dim_y, hist_fill(hist, view.cells, num_cells));
+}
+
+// one routing iteration as measured by routing(); a widened iteration only
+// counts once it is redone
+typedef struct {
+    double wall;        // seconds
+    double prob;        // random-move probability
+    quality_t quality;  // after the iteration
+    int max;            // max occupancy after the iteration
+    long long rerouted; // wires whose route changed
+} iteration_t;
+
+// what routing() measured, for the -j report
+typedef struct {
+    route_mode_t mode; // as routed, after a fallback from color
+    int num_threads;
+    int threshold;     // congestion threshold of quality_t::over
+    counters_t *counters;
+    quality_t initial;
+    int initial_max;
+    quality_t final;   // of the routes written out, after any restore
+    int final_max;
+    int restored;      // iteration whose routes were put back, -1 the initial ones
+    bool was_restored;
+    int widenings;
+    long long decisions, stale_decisions, stale_drift; // atomic mode
+    int num_iters;
+    iteration_t *iters;
+} stats_t;
+
+static void stats_free(stats_t *stats){
+    free(stats->counters);
+    free(stats->iters);
+}
+
+static long long counters_rerouted(const counters_t *counters, int num_threads){
+    long long total = 0;
+    for (int t = 0; t < num_threads; t++){
+        total += counters[t].rerouted;
+    }
+    return total;
+}
+
+// how routing() ranks the routes after an iteration: by the routing cost, and
+// under OBJECTIVE_MAX by the max occupancy first
+typedef struct {
+    int max;           // 0 unless OBJECTIVE_MAX
+    long long squared;
+} score_t;
+
+static inline score_t routing_score(quality_t quality, int max_occupancy, objective_t objective){
+    score_t score = {(objective == OBJECTIVE_MAX) ? max_occupancy : 0, quality.squared};
+    return score;
+}
+
+static inline bool score_less(score_t a, score_t b){
+    return a.max < b.max || (a.max == b.max && a.squared < b.squared);
+}
+
+// relative improvement from prev to cur, by the max occupancy when it changed
+static double score_gain(score_t prev, score_t cur){
+    if (prev.max != cur.max) return (double)(prev.max - cur.max) / std::max(prev.max, 1);
+    return prev.squared ? (double)(prev.squared - cur.squared) / prev.squared : 0.0;
+}
+
+// perform the wire routing iterations; threshold is the occupancy above which
+// a cell counts as congested in the quality printed after every iteration
+static void routing(wires_t *wires, grid_t *grid, int dim_x, int dim_y, 
+                    int num_wires, anneal_t anneal, int num_threads, route_mode_t mode,
+                    objective_t objective, uint64_t seed, const simd_t *simd, balance_t balance,
+                    int threshold, stats_t *stats){
+    long long decisions = 0, stale_decisions = 0, stale_drift = 0;
+    counters_t *counters = (counters_t*)calloc(num_threads, sizeof(counters_t));
+    memset(stats, 0, sizeof(stats_t));
+    stats->iters = (iteration_t*)calloc(std::max(anneal.max_iters, 1), sizeof(iteration_t));
+
+    // scratch and occupancy changes for every thread, reused by all iterations
+    prefix_t *arenas = (prefix_t*)calloc(num_threads, sizeof(prefix_t));
+    hist_t *hists = (hist_t*)calloc(num_threads, sizeof(hist_t));
+    for (int t = 0; t < num_threads; t++){
+        arenas[t].track_max = (objective == OBJECTIVE_MAX);
+        arenas[t].simd = simd;
+    }
+
+    // the only full scan of the grid (unless it is promoted), add_cost and
+    // clear_cost keep it up to date
+    hist_t occupancy = {0, NULL, 0, 0, false};
+    grid_histogram(grid, dim_x, dim_y, &occupancy);
+
+    coloring_t coloring = {0, NULL, NULL};
+    // within, like color, routes the same for any number of threads
+    if (mode == MODE_COLOR && !color_wires(wires, num_wires, dim_x, dim_y, &coloring)){
+        printf("Falling back to within mode.\n");
+        mode = MODE_WITHIN;
+    }
+
+    regions_t regions = {0, false, NULL, NULL, NULL, NULL};
+    if (mode == MODE_REGION) regions_build(wires, dim_x, dim_y, num_threads, &regions);
+
+    schedule_t sched;
+    schedule_init(&sched, wires, num_threads, balance);
+
+    quality_t quality = hist_quality(&occupancy, threshold);
+    score_t prev = routing_score(quality, occupancy.max, objective);
+    double prob = anneal.prob;
+    printf("Initial cost: %lld, max occupancy %d.\n", quality.squared, occupancy.max);
+    printf("Initial quality: occupancy %lld, cells over %d: %lld.\n", quality.occupancy, threshold, quality.over);
+    stats->initial = quality;
+    stats->initial_max = occupancy.max;
+
+    // the best routes seen so far, put back at the end if the last iterations
+    // made things worse
+    score_t best = prev;
+    int best_iter = -1;
+    coord_t *best_bend = (coord_t*)malloc(std::max(num_wires, 1) * sizeof(coord_t));
+    uint8_t *best_vertical_first = (uint8_t*)malloc(std::max(num_wires, 1) * sizeof(uint8_t));
+    memcpy(best_bend, wires->bend, num_wires * sizeof(coord_t));
+    memcpy(best_vertical_first, wires->vertical_first, num_wires * sizeof(uint8_t));
+    score_t cur = prev;
+
+    // loop iterations for improvement (inside which each wire is checked)
+    for (int i = 0; i < anneal.max_iters; i++){
+        uint64_t iteration_seed = rng_iteration(seed, i);
+        double iteration_start = omp_get_wtime();
+        long long rerouted_before = counters_rerouted(counters, num_threads);
+        int limit = cell_limit(grid->width, (mode == MODE_ATOMIC) ? num_threads : 0);
+        for (int t = 0; t < num_threads; t++){
+            hists[t].limit = limit;
+        }
+
+        GRID_VISIT(grid, dim_x, dim_y, route_iteration(wires, view, num_wires, num_threads, mode,
+                                                iteration_seed, prob, &coloring, &regions, arenas, hists, &sched,
+                                                counters, &decisions, &stale_decisions, &stale_drift));
+
+        bool saturated = false;
+        for (int t = 0; t < num_threads; t++){
+            saturated = saturated || hists[t].saturated;
+        }
+        if (saturated){
+            // the updates that saturated were undone, so the grid no longer
+            // matches the stored routes: rebuild it from them one size wider
+            // and redo the iteration
+            free(grid->cells);
+            grid->width = (cell_width_t)(grid->width + 1);
+            printf("Iteration %d: cell saturated, widening the grid to %d-bit cells.\n",
+                   i, cell_bits(grid->width));
+            grid_build(grid, wires, dim_x, dim_y, num_threads);
+            for (int t = 0; t < num_threads; t++){
+                free(hists[t].count);
+                memset(&hists[t], 0, sizeof(hist_t));
+            }
+            grid_histogram(grid, dim_x, dim_y, &occupancy);
+            stats->widenings++;
+            i--;
+            continue;
+        }
+
+        for (int t = 0; t < num_threads; t++){
+            hist_merge(&occupancy, &hists[t]);
+        }
+        quality = hist_quality(&occupancy, threshold);
+        cur = routing_score(quality, occupancy.max, objective);
+        double gain = score_gain(prev, cur);
+        iteration_t *iter = &stats->iters[i];
+        iter->wall = omp_get_wtime() - iteration_start;
+        iter->prob = prob;
+        iter->quality = quality;
+        iter->max = occupancy.max;
+        iter->rerouted = counters_rerouted(counters, num_threads) - rerouted_before;
+        stats->num_iters = i + 1;
+        printf("Iteration %d: cost %lld, max occupancy %d, random-move probability %.4f.\n",
+               i, quality.squared, occupancy.max, prob);
+        printf("Iteration %d quality: occupancy %lld, cells over %d: %lld, wires rerouted %lld, %.3f s.\n",
+               i, quality.occupancy, threshold, quality.over, iter->rerouted, iter->wall);
+
+        if (score_less(cur, best)){
+            best = cur;
+            best_iter = i;
+            memcpy(best_bend, wires->bend, num_wires * sizeof(coord_t));
+            memcpy(best_vertical_first, wires->vertical_first, num_wires * sizeof(uint8_t));
+        }
+
+        if (gain >= 0 && gain < anneal.min_gain){
+            printf("Converged after %d iterations (gain %.5f < %.5f).\n", i + 1, gain, anneal.min_gain);
+            break;
+        }
+        prev = cur;
+        prob *= anneal.decay;
+    }
+
+    if (score_less(best, cur)){
+        if (best_iter < 0) printf("Restoring the initial routes (cost %lld).\n", best.squared);
+        else printf("Restoring the routes of iteration %d (cost %lld).\n", best_iter, best.squared);
+        memcpy(wires->bend, best_bend, num_wires * sizeof(coord_t));
+        memcpy(wires->vertical_first, best_vertical_first, num_wires * sizeof(uint8_t));
+        free(grid->cells);
+        grid_build(grid, wires, dim_x, dim_y, num_threads);
+        grid_histogram(grid, dim_x, dim_y, &occupancy);
+        quality = hist_quality(&occupancy, threshold);
+        stats->restored = best_iter;
+        stats->was_restored = true;
+    }
+    free(best_bend);
+    free(best_vertical_first);
+    // what is written out, unlike the last iteration when routes were restored
+    printf("Final cost: %lld, max occupancy %d.\n", quality.squared, occupancy.max);
+    stats->final = quality;
+    stats->final_max = occupancy.max;
+
+    if (mode == MODE_ACROSS || mode == MODE_ATOMIC || mode == MODE_REGION){
+        double busy_max = 0, busy_sum = 0;
+        printf("Thread busy time:");
+        for (int t = 0; t < num_threads; t++){
+            printf(" %.3f", counters[t].busy);
+            busy_max = std::max(busy_max, counters[t].busy);
+            busy_sum += counters[t].busy;
+        }
+        printf(" s, max/mean %.3f.\n", busy_sum > 0 ? busy_max * num_threads / busy_sum : 1.0);
+    }
+    schedule_free(&sched);
+
+    if (mode == MODE_ATOMIC){
+        printf("Stale route decisions: %lld of %lld (%.2f%%), mean cost drift %.3f.\n",
+               stale_decisions, decisions, decisions ? 100.0 * stale_decisions / decisions : 0.0,
+               stale_decisions ? (double)stale_drift / stale_decisions : 0.0);
+    }
+
+    long long allocs = 0;
+    for (int t = 0; t < num_threads; t++){
+        allocs += arenas[t].allocs;
+        prefix_free(&arenas[t]);
+        free(hists[t].count);
+    }
+    free(arenas);
+    free(hists);
+    free(occupancy.count);
+    printf("Scratch allocations: %lld.\n", allocs);
+
+    free(coloring.order);
+    free(coloring.start);
+    regions_free(&regions);
+
+    stats->mode = mode;
+    stats->num_threads = num_threads;
+    stats->threshold = threshold;
+    stats->counters = counters;
+    stats->decisions = decisions;
+    stats->stale_decisions = stale_decisions;
+    stats->stale_drift = stale_drift;
+}
+
+// output buffer of one thread, reused by every chunk it formats
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} outbuf_t;
+
+// longest formatted int plus its separator
+#define OUT_INT_MAX 12
+// bytes formatted by one thread before the round is written
+#define OUT_CHUNK (1 << 20)
+#define OUT_WIRES_PER_CHUNK 1024
+
+static void outbuf_reserve(outbuf_t *buf, size_t extra){
+    if (buf->len + extra <= buf->cap) return;
+    buf->cap = std::max(2 * buf->cap, buf->len + extra);
+    buf->data = (char*)realloc(buf->data, buf->cap);
+}
+
+// append v and sep; the caller has reserved OUT_INT_MAX bytes
+static inline void outbuf_int(outbuf_t *buf, int v, char sep){
+    char digits[10];
+    int n = 0;
+    unsigned int u = (v < 0) ? 0u - (unsigned int)v : (unsigned int)v;
+    do {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+
+    char *out = buf->data + buf->len;
+    if (v < 0) *out++ = '-';
+    while (n) *out++ = digits[--n];
+    *out++ = sep;
+    buf->len = out - buf->data;
+}
+
+static inline void outbuf_varint(outbuf_t *buf, uint64_t v){
+    buf->len = varint_put(buf->data + buf->len, v) - buf->data;
+}
+
+// writev the whole iovec, resuming after short writes
+static bool write_full(int fd, struct iovec *iov, int count){
+    while (count > 0){
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0){
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len){
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0){
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// write items [0, num_items) in order. In every round each thread formats
+// chunk_items consecutive items into its own buffer, then the round goes out
+// as a single writev of all the buffers.
+template <typename FORMAT>
+static bool write_chunked(int fd, int num_items, int chunk_items, int num_threads, FORMAT format){
+    outbuf_t *bufs = (outbuf_t*)calloc(num_threads, sizeof(outbuf_t));
+    struct iovec *iov = (struct iovec*)malloc(num_threads * sizeof(struct iovec));
+    bool ok = true;
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int t = omp_get_thread_num();
+        int team = omp_get_num_threads();
+        outbuf_t *buf = &bufs[t];
+
+        for (long long first = 0; first < num_items; first += (long long)team * chunk_items){
+            long long lo = std::min(first + (long long)t * chunk_items, (long long)num_items);
+            long long hi = std::min(lo + chunk_items, (long long)num_items);
+            buf->len = 0;
+            for (long long i = lo; i < hi; i++){
+                format(buf, (int)i);
+            }
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                for (int b = 0; b < team; b++){
+                    iov[b].iov_base = bufs[b].data;
+                    iov[b].iov_len = bufs[b].len;
                 }
+                if (ok) ok = write_full(fd, iov, team);
+            }
+        }
+    }
+
+    for (int t = 0; t < num_threads; t++){
+        free(bufs[t].data);
+    }
+    free(bufs);
+    free(iov);
+    return ok;
+}
+
+static int open_output(const char *filename){
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0){
+        printf("Error: Cannot write %s.\n", filename);
+    }
+    return fd;
+}
+
+static void close_output(int fd, bool ok, const char *filename){
+    if (close(fd) != 0 || !ok){
+        printf("Error: Failed writing %s.\n", filename);
+    }
+}
+
+// cost file: the dimensions, then one line per row
+template <typename GRID>
+static void write_costs(const char *filename, GRID grid, int dim_x, int dim_y, int num_threads){
+    int fd = open_output(filename);
+    if (fd < 0) return;
+
+    char header[32];
+    struct iovec iov = {header, (size_t)sprintf(header, "%d %d\n", dim_y, dim_x)};
+    bool ok = write_full(fd, &iov, 1);
+
+    size_t row_bytes = (size_t)dim_x * OUT_INT_MAX + 1;
+    int chunk_rows = std::max(1, (int)(OUT_CHUNK / row_bytes));
+    ok = ok && write_chunked(fd, dim_y, chunk_rows, num_threads, [&](outbuf_t *buf, int row){
+        outbuf_reserve(buf, row_bytes);
+        for (int col = 0; col < dim_x; ){
+            int len = grid.run(col, dim_x - col);
+            const typename GRID::cell_t *cells = &grid.at(col, row);
+            for (int i = 0; i < len; i++){
+                outbuf_int(buf, cells[i], ' ');
             }
+            col += len;
+        }
+        buf->data[buf->len++] = '\n';
+    });
+
+    close_output(fd, ok, filename);
+}
+
+// route file: the dimensions, the number of wires, then every cell of every
+// route in order from start to end
+static void write_routes(const char *filename, const wires_t *wires, int dim_x, int dim_y, int num_threads){
+    int fd = open_output(filename);
+    if (fd < 0) return;
+
+    char header[48];
+    struct iovec iov = {header, (size_t)sprintf(header, "%d %d\n%d \n", dim_y, dim_x, wires->num_wires)};
+    bool ok = write_full(fd, &iov, 1);
+
+    ok = ok && write_chunked(fd, wires->num_wires, OUT_WIRES_PER_CHUNK, num_threads, [&](outbuf_t *buf, int w){
+        // "x y " for every cell, with room for the newline after the end cell
+        route_points(wire_load(wires, w), [buf](int x, int y){
+            outbuf_reserve(buf, 2 * OUT_INT_MAX + 1);
+            outbuf_int(buf, x, ' ');
+            outbuf_int(buf, y, ' ');
+        });
+        buf->data[buf->len++] = '\n';
+    });
+
+    close_output(fd, ok, filename);
+}
+
+// magic and the varint header fields of a binary file
+static bool write_bin_header(int fd, const char *magic, const uint64_t *fields, int num_fields){
+    char header[4 + 8 * VARINT_MAX];
+    memcpy(header, magic, 4);
+    char *out = header + 4;
+    for (int f = 0; f < num_fields; f++){
+        out = varint_put(out, fields[f]);
+    }
+    struct iovec iov = {header, (size_t)(out - header)};
+    return write_full(fd, &iov, 1);
+}
+
+// binary cost file, see wireformat.h: every row as runs of equal cells
+template <typename GRID>
+static void write_costs_bin(const char *filename, GRID grid, int dim_x, int dim_y, int num_threads){
+    int fd = open_output(filename);
+    if (fd < 0) return;
+
+    uint64_t header[] = {WIREFILE_VERSION, (uint64_t)dim_y, (uint64_t)dim_x};
+    bool ok = write_bin_header(fd, WIREFILE_COSTS_MAGIC, header, 3);
+
+    size_t row_bytes = (size_t)dim_x * 2 * VARINT_MAX;
+    int chunk_rows = std::max(1, (int)(OUT_CHUNK / row_bytes));
+    ok = ok && write_chunked(fd, dim_y, chunk_rows, num_threads, [&](outbuf_t *buf, int row){
+        outbuf_reserve(buf, row_bytes);
+        for (int col = 0; col < dim_x; ){
+            int value = grid.at(col, row);
+            int run = col + 1;
+            while (run < dim_x && grid.at(run, row) == value) run++;
+            outbuf_varint(buf, (uint64_t)value);
+            outbuf_varint(buf, (uint64_t)(run - col));
+            col = run;
+        }
+    });
+
+    close_output(fd, ok, filename);
+}
+
+// cost file in text or binary, whatever the width and layout of the grid
+static void write_grid(const char *filename, const grid_t *grid, int dim_x, int dim_y, int num_threads,
+                       bool binary){
+    if (binary) GRID_VISIT(grid, dim_x, dim_y, write_costs_bin(filename, view, dim_x, dim_y, num_threads));
+    else GRID_VISIT(grid, dim_x, dim_y, write_costs(filename, view, dim_x, dim_y, num_threads));
+}
+
+// binary route file, see wireformat.h: endpoints and the bend of every wire
+static void write_routes_bin(const char *filename, const wires_t *wires, int dim_x, int dim_y, int num_threads){
+    int fd = open_output(filename);
+    if (fd < 0) return;
+
+    uint64_t header[] = {WIREFILE_VERSION, (uint64_t)dim_y, (uint64_t)dim_x, (uint64_t)wires->num_wires};
+    bool ok = write_bin_header(fd, WIREFILE_ROUTES_MAGIC, header, 4);
+
+    ok = ok && write_chunked(fd, wires->num_wires, OUT_WIRES_PER_CHUNK, num_threads, [&](outbuf_t *buf, int w){
+        wire_t wire = wire_load(wires, w);
+        outbuf_reserve(buf, 5 * VARINT_MAX);
+        outbuf_varint(buf, (uint64_t)wire.startx);
+        outbuf_varint(buf, (uint64_t)wire.starty);
+        outbuf_varint(buf, zigzag(wire.endx - wire.startx));
+        outbuf_varint(buf, zigzag(wire.endy - wire.starty));
+        int from = wire.vertical_first ? wire.starty : wire.startx;
+        outbuf_varint(buf, zigzag(wire.bend - from) << 1 | wire.vertical_first);
+    });
+
+    close_output(fd, ok, filename);
+}
+
+// one thread's share of the body of a text file, whole lines only
+typedef struct {
+    const char *lo;
+    const char *hi;
+    int first_line;   // line number of lo
+    int first_item;   // index of the first wire (or cost row) in the chunk
+    int num_lines;
+    int num_items;    // non-blank lines
+    int error_line;   // first bad line, 0 if none
+    char error[128];
+} parse_chunk_t;
+
+static inline const char *skip_blanks(const char *p, const char *end){
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+// parse the next integer on the line at *pp into *v. Returns 1 and moves *pp
+// past it, 0 at the end of the line (*pp is then at the newline or end), or -1
+// if the next token is not an integer.
+static inline int parse_int(const char **pp, const char *end, long long *v){
+    const char *p = skip_blanks(*pp, end);
+    *pp = p;
+    if (p == end || *p == '\n') return 0;
+
+    bool neg = (*p == '-');
+    p += neg;
+    const char *digits = p;
+    long long u = 0;
+    // 12 digits fit a long long and are out of range for any grid anyway
+    while (p < end && (unsigned int)(*p - '0') < 10u && p - digits < 12){
+        u = 10 * u + (*p++ - '0');
+    }
+    if (p == digits || (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')) return -1;
+    *v = neg ? -u : u;
+    *pp = p;
+    return 1;
+}
+
+// the start of the line after the one at p
+static inline const char *next_line(const char *p, const char *end){
+    const char *eol = (const char*)memchr(p, '\n', end - p);
+    return eol ? eol + 1 : end;
+}
+
+// parse the whitespace-separated integers on the line at *pp into vals and
+// move *pp to the next line. Returns how many there were, or -1 if the line
+// holds anything that is not an integer.
+static int parse_ints(const char **pp, const char *end, long long *vals, int max_vals){
+    const char *p = *pp;
+    int n = 0;
+    long long v;
+    for (int r; (r = parse_int(&p, end, &v)) != 0; n++){
+        if (r < 0){
+            *pp = next_line(p, end);
+            return -1;
+        }
+        if (n < max_vals) vals[n] = v;
+    }
+    *pp = (p < end) ? p + 1 : end;
+    return n;
+}
+
+// start of the first line at or after off
+static const char *line_start(const char *base, const char *body, const char *end, size_t off){
+    const char *p = base + off;
+    if (p <= body) return body;
+    if (p >= end) return end;
+    const char *eol = (const char*)memchr(p - 1, '\n', end - (p - 1));
+    return eol ? eol + 1 : end;
+}
+
+// map a whole file for reading; false (with a message) if it cannot be
+// opened or is empty
+static bool map_file(const char *filename, const char **base, size_t *size){
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0){
+        printf("Unable to open file: %s.\n", filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0){
+        printf("Error: %s:1: expected the grid dimensions.\n", filename);
+        close(fd);
+        return false;
+    }
+    *size = st.st_size;
+    *base = (const char*)mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*base == MAP_FAILED){
+        printf("Unable to map file: %s.\n", filename);
+        return false;
+    }
+    madvise((void*)*base, *size, MADV_SEQUENTIAL);
+    return true;
+}
+
+// called by every thread of a parallel region: thread t of team takes its
+// line-aligned share of body..end, counts its lines and the non-blank ones,
+// and once all have counted, every chunk knows the number of its first line
+// (body being on line first_line) and of its first item
+static void chunk_lines(parse_chunk_t *chunks, int t, int team,
+                        const char *base, const char *body, const char *end, int first_line){
+    parse_chunk_t *chunk = &chunks[t];
+    size_t body_len = end - body, body_off = body - base;
+    chunk->lo = line_start(base, body, end, body_off + body_len * t / team);
+    chunk->hi = line_start(base, body, end, body_off + body_len * (t + 1) / team);
+
+    for (const char *q = chunk->lo; q < chunk->hi; ){
+        const char *eol = (const char*)memchr(q, '\n', chunk->hi - q);
+        if (!eol) eol = chunk->hi;
+        chunk->num_lines++;
+        chunk->num_items += (skip_blanks(q, eol) != eol);
+        q = eol + 1;
+    }
+
+    #pragma omp barrier
+    #pragma omp single
+    {
+        int line = first_line, item = 0;
+        for (int c = 0; c < team; c++){
+            chunks[c].first_line = line;
+            chunks[c].first_item = item;
+            line += chunks[c].num_lines;
+            item += chunks[c].num_items;
         }
     }
-    return total_cost;
 }
 
-// check to see if the start points and end points are on a straight line
-static bool on_straight_line(wire_t wire){
-    return (wire.startx == wire.endx || wire.starty == wire.endy);
+// the first error of any chunk, which is the first in the file since chunks
+// are in file order; false if there was one
+static bool chunks_ok(const parse_chunk_t *chunks, int team, const char *filename){
+    for (int c = 0; c < team; c++){
+        if (chunks[c].error_line){
+            printf("Error: %s:%d: %s.\n", filename, chunks[c].error_line, chunks[c].error);
+            return false;
+        }
+    }
+    return true;
 }
 
-static void add_cost(wire_t wire, cost_t *costs, int dim_x, int dim_y){
-    //printf("ENTERING ADD_COST......\n");
-
-    int y_step, x_step;
-
-    if (wire.bend_1){
-        if (wire.startx == wire.bend_1x){
-            // vertical until bend 1
-            if (wire.starty < wire.bend_1y){
-                for (y_step = wire.starty; y_step < wire.bend_1y; y_step++){
-                    costs[wire.startx + dim_x * y_step] += 1;
-                }
+// map the netlist and parse it: the grid size, the number of wires, then one
+// "startx starty endx endy" line per wire. The body is split into line-aligned
+// chunks that are counted, then parsed straight into the wire store, one per
+// thread. Errors name the offending line.
+static bool load_netlist(const char *filename, int *dim_x, int *dim_y, wires_t *wires, int num_threads){
+    const char *base;
+    size_t size;
+    if (!map_file(filename, &base, &size)) return false;
+    const char *end = base + size;
+
+    const char *p = base;
+    long long header[2];
+    if (parse_ints(&p, end, header, 2) != 2 || header[0] <= 0 || header[1] <= 0 ||
+        header[0] > INT32_MAX || header[1] > INT32_MAX){
+        printf("Error: %s:1: expected the grid dimensions.\n", filename);
+        munmap((void*)base, size);
+        return false;
+    }
+    *dim_y = (int)header[0];
+    *dim_x = (int)header[1];
+    if (parse_ints(&p, end, header, 1) != 1 || header[0] < 0 || header[0] > INT32_MAX){
+        printf("Error: %s:2: expected the number of wires.\n", filename);
+        munmap((void*)base, size);
+        return false;
+    }
+    int num_wires = (int)header[0];
+
+    // every coordinate has to fit the compact wire store
+    if (*dim_x - 1 > COORD_MAX || *dim_y - 1 > COORD_MAX){
+        printf("Error: %dx%d grid does not fit %d-bit coordinates, rebuild with -DWIREROUTE_WIDE_COORDS.\n",
+               *dim_y, *dim_x, (int)(8 * sizeof(coord_t)));
+        munmap((void*)base, size);
+        return false;
+    }
+    wires_alloc(wires, num_wires);
+
+    const char *body = p;
+    parse_chunk_t *chunks = (parse_chunk_t*)calloc(num_threads, sizeof(parse_chunk_t));
+    int team = 1;
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int t = omp_get_thread_num();
+        #pragma omp single
+        team = omp_get_num_threads();
+
+        chunk_lines(chunks, t, team, base, body, end, 3);
+
+        parse_chunk_t *chunk = &chunks[t];
+        int line = chunk->first_line, wid = chunk->first_item;
+        for (const char *q = chunk->lo; q < chunk->hi && !chunk->error_line; line++){
+            long long v[4];
+            int n = parse_ints(&q, chunk->hi, v, 4);
+            if (n == 0) continue;
+
+            if (n != 4){
+                chunk->error_line = line;
+                snprintf(chunk->error, sizeof(chunk->error), "expected 4 coordinates");
+            } else if (wid >= num_wires){
+                chunk->error_line = line;
+                snprintf(chunk->error, sizeof(chunk->error), "more wires than the %d declared on line 2", num_wires);
+            } else if (v[0] < 0 || v[0] >= *dim_x || v[2] < 0 || v[2] >= *dim_x ||
+                       v[1] < 0 || v[1] >= *dim_y || v[3] < 0 || v[3] >= *dim_y){
+                chunk->error_line = line;
+                snprintf(chunk->error, sizeof(chunk->error), "wire (%lld, %lld) -> (%lld, %lld) is outside the %dx%d grid",
+                         v[0], v[1], v[2], v[3], *dim_y, *dim_x);
             } else{
-                for (y_step = wire.starty; y_step > wire.bend_1y; y_step--){
-                    costs[wire.startx + dim_x * y_step] += 1;
-                }
+                wires->startx[wid] = (coord_t)v[0];
+                wires->starty[wid] = (coord_t)v[1];
+                wires->endx[wid] = (coord_t)v[2];
+                wires->endy[wid] = (coord_t)v[3];
+
+                // travel horizontally first and bend above/below the end point
+                wires->vertical_first[wid] = false;
+                wires->bend[wid] = (coord_t)v[2];
+                wid++;
             }
+        }
+    }
 
-            if (wire.bend_2){
-                // horizontal until bend 2
-                if (wire.bend_1x < wire.bend_2x){
-                    for (x_step = wire.bend_1x; x_step < wire.bend_2x; x_step++){
-                        costs[x_step + dim_x * wire.bend_1y] += 1;
-                    }
-                } else{
-                    for (x_step = wire.bend_1x; x_step > wire.bend_2x; x_step--){
-                        costs[x_step + dim_x * wire.bend_1y] += 1;
-                    }
-                }
+    bool ok = chunks_ok(chunks, team, filename);
+    int found = chunks[team - 1].first_item + chunks[team - 1].num_items;
+    if (ok && found < num_wires){
+        printf("Error: %s: expected %d wires, found %d.\n", filename, num_wires, found);
+        ok = false;
+    }
 
-                // vertical from bend 2 to end
-                if (wire.bend_2y < wire.endy){
-                    for (y_step = wire.bend_2y; y_step <= wire.endy; y_step++){
-                        costs[wire.bend_2x + dim_x * y_step] += 1;
-                    }
-                } else {
-                    for (y_step = wire.bend_2y; y_step >= wire.endy; y_step--){
-                        costs[wire.bend_2x + dim_x * y_step] += 1;
-                    }
-                }
-            } else{
-                // only bend 1
+    free(chunks);
+    munmap((void*)base, size);
+    if (!ok) wires_free(wires);
+    return ok;
+}
 
-                // horizontal from bend 1 to end
-                if (wire.bend_1x < wire.endx){
-                    for (x_step = wire.bend_1x; x_step <= wire.endx; x_step++){
-                        costs[x_step + dim_x * wire.bend_1y] += 1;
-                    }
-                } else{
-                    for (x_step = wire.bend_1x; x_step >= wire.endx; x_step--){
-                        costs[x_step + dim_x * wire.bend_1y] += 1;
-                    }
-                }
+// -validate: check a route file and a cost file against the netlist, in
+// either output format. Every route has to be a contiguous walk in the grid
+// with at most two bends, the routes have to connect exactly the wires of
+// the netlist (in any order and direction), and the cost file has to hold
+// the occupancy the routes give.
+
+// parse the route on the line at *pp ("x y x y ...", every cell from one end
+// to the other) into wire and move *pp to the next line. Returns 1, 0 for a
+// blank line, or -1 with the problem in error.
+static int parse_route(const char **pp, const char *end, int dim_x, int dim_y, wire_t *wire,
+                       char *error, size_t error_size){
+    const char *p = *pp;
+    int num_points = 0, bends = 0;
+    int px = 0, py = 0, dir_x = 0, dir_y = 0;
+    for (;;){
+        long long x, y;
+        int r = parse_int(&p, end, &x);
+        if (r == 0) break;
+        if (r > 0) r = parse_int(&p, end, &y);
+        if (r <= 0){
+            snprintf(error, error_size, r ? "expected integer coordinates" : "coordinates do not come in pairs");
+            *pp = next_line(p, end);
+            return -1;
+        }
+        if (x < 0 || x >= dim_x || y < 0 || y >= dim_y){
+            snprintf(error, error_size, "(%lld, %lld) is outside the %dx%d grid", x, y, dim_y, dim_x);
+            *pp = next_line(p, end);
+            return -1;
+        }
+
+        if (num_points == 0){
+            wire->startx = (int)x;
+            wire->starty = (int)y;
+            wire->vertical_first = false;
+        } else{
+            int step_x = (int)x - px, step_y = (int)y - py;
+            const char *problem = NULL;
+            if (abs(step_x) + abs(step_y) != 1){
+                problem = "is not a step to a neighbouring cell";
+            } else if (num_points == 1){
+                wire->vertical_first = (step_y != 0);
+            } else if (step_x != dir_x || step_y != dir_y){
+                if (step_x == -dir_x && step_y == -dir_y) problem = "doubles back";
+                else if (++bends > 2) problem = "is a third bend";
+                // the first bend is at the column (row) of the middle segment
+                else if (bends == 1) wire->bend = wire->vertical_first ? py : px;
             }
+            if (problem){
+                snprintf(error, error_size, "(%d, %d) -> (%lld, %lld) %s", px, py, x, y, problem);
+                *pp = next_line(p, end);
+                return -1;
+            }
+            dir_x = step_x;
+            dir_y = step_y;
+        }
+        px = (int)x;
+        py = (int)y;
+        num_points++;
+    }
+    *pp = (p < end) ? p + 1 : end;
+    if (num_points == 0) return 0;
+
+    wire->endx = px;
+    wire->endy = py;
+    if (bends == 0){
+        // straight, stored horizontal first with the bend at endx
+        wire->vertical_first = false;
+        wire->bend = px;
+    }
+    return 1;
+}
 
-        } else if (wire.starty == wire.bend_1y){
-            // horizontal from start to bend 1
+static bool load_routes_text(const char *filename, const char *base, const char *end,
+                             int dim_x, int dim_y, wires_t *routes, int num_threads){
+    const char *p = base;
+    long long header[2];
+    if (parse_ints(&p, end, header, 2) != 2 || header[0] != dim_y || header[1] != dim_x){
+        printf("Error: %s:1: expected the grid dimensions %d %d.\n", filename, dim_y, dim_x);
+        return false;
+    }
+    if (parse_ints(&p, end, header, 1) != 1 || header[0] != routes->num_wires){
+        printf("Error: %s:2: expected the number of wires, %d.\n", filename, routes->num_wires);
+        return false;
+    }
 
-            if (wire.startx < wire.bend_1x){
-                for (x_step = wire.startx; x_step < wire.bend_1x; x_step++){
-                    costs[x_step + dim_x * wire.starty] += 1;
-                }
+    const char *body = p;
+    parse_chunk_t *chunks = (parse_chunk_t*)calloc(num_threads, sizeof(parse_chunk_t));
+    int team = 1;
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int t = omp_get_thread_num();
+        #pragma omp single
+        team = omp_get_num_threads();
+
+        chunk_lines(chunks, t, team, base, body, end, 3);
+
+        parse_chunk_t *chunk = &chunks[t];
+        int line = chunk->first_line, wid = chunk->first_item;
+        for (const char *q = chunk->lo; q < chunk->hi && !chunk->error_line; line++){
+            wire_t wire = {0, 0, 0, 0, 0, false};
+            int r = parse_route(&q, chunk->hi, dim_x, dim_y, &wire, chunk->error, sizeof(chunk->error));
+            if (r == 0) continue;
+
+            if (r < 0){
+                chunk->error_line = line;
+            } else if (wid >= routes->num_wires){
+                chunk->error_line = line;
+                snprintf(chunk->error, sizeof(chunk->error), "more routes than the %d declared on line 2",
+                         routes->num_wires);
             } else{
-                for (x_step = wire.startx; x_step > wire.bend_1x; x_step--){
-                    costs[x_step + dim_x * wire.starty] += 1;
-                }
+                wire_store(routes, wid++, wire);
             }
+        }
+    }
 
-            if (wire.bend_2){
-                // vertical until bend 2
-                if (wire.bend_1y < wire.bend_2y){
-                    for (y_step = wire.bend_1y; y_step < wire.bend_2y; y_step++){
-                        costs[wire.bend_1x + dim_x * y_step] += 1;
-                    }
-                } else{
-                    for (y_step = wire.bend_1y; y_step > wire.bend_2y; y_step--){
-                        costs[wire.bend_1x + dim_x * y_step] += 1;
-                    }
-                }
+    bool ok = chunks_ok(chunks, team, filename);
+    int found = chunks[team - 1].first_item + chunks[team - 1].num_items;
+    if (ok && found < routes->num_wires){
+        printf("Error: %s: expected %d routes, found %d.\n", filename, routes->num_wires, found);
+        ok = false;
+    }
+    free(chunks);
+    return ok;
+}
 
-                // horizontal from bend 2 to end
-                if (wire.bend_2x < wire.endx){
-                    for (x_step = wire.bend_2x; x_step <= wire.endx; x_step++){
-                        costs[x_step + dim_x * wire.bend_2y] += 1;
-                    }
-                } else {
-                    for (x_step = wire.bend_2x; x_step >= wire.endx; x_step--){
-                        costs[x_step + dim_x * wire.bend_2y] += 1;
-                    }
-                }
-            } else{
-                // only bend 1
-
-                // vertical from bend 1 to end
-                if (wire.bend_1y < wire.endy){
-                    for (y_step = wire.bend_1y; y_step <= wire.endy; y_step++){
-                        costs[wire.bend_1x + dim_x * y_step] += 1;
-                        // printf("index: (%d, %d), cost: %d\n", wire.bend_1x, step, 
-                        //         costs[wire.bend_1x + dim_x * step]);
-                    }
-                } else{
-                    for (y_step = wire.bend_1y; y_step >= wire.endy; y_step--){
-                        costs[wire.bend_1x + dim_x * y_step] += 1;
-                        // printf("index: (%d, %d), cost: %d\n", wire.bend_1x, step, 
-                        //         costs[wire.bend_1x + dim_x * step]);
-                    }
-                }
-            }
-        } 
-    } else{
-        // no bends
-        if (wire.startx == wire.endx){
-            // vertical line from start to end
-            if (wire.starty < wire.endy){
-                for (y_step = wire.starty; y_step <= wire.endy; y_step++){
-                    costs[wire.startx + dim_x * y_step] += 1;
-                }
-            } else{
-                for (y_step = wire.starty; y_step >= wire.endy; y_step--){
-                    costs[wire.startx + dim_x * y_step] += 1;
-                }
-            }
-            //printf("wire #%d with cost %d\n", i, wires[i].total_cost);
-        } else if (wire.starty == wire.endy){
-            if (wire.startx < wire.endx){
-                for (x_step = wire.startx; x_step <= wire.endx; x_step++){
-                    costs[x_step + dim_x * wire.starty] += 1;
-                }
-            } else{
-                for (x_step = wire.startx; x_step >= wire.endx; x_step--){
-                    costs[x_step + dim_x * wire.starty] += 1;
-                }
+// the binary routes are stored as wire_t already, only their range is checked
+static bool load_routes_bin(const char *filename, const char *base, const char *end,
+                            int dim_x, int dim_y, wires_t *routes){
+    const unsigned char *p = (const unsigned char*)base + 4, *stop = (const unsigned char*)end;
+    uint64_t header[4];
+    for (int f = 0; f < 4; f++){
+        if (!varint_get(&p, stop, &header[f])){
+            printf("Error: %s is truncated.\n", filename);
+            return false;
+        }
+    }
+    if (header[0] != WIREFILE_VERSION || header[1] != (uint64_t)dim_y || header[2] != (uint64_t)dim_x ||
+        header[3] != (uint64_t)routes->num_wires){
+        printf("Error: %s: expected version %d, a %dx%d grid and %d wires.\n",
+               filename, WIREFILE_VERSION, dim_y, dim_x, routes->num_wires);
+        return false;
+    }
+
+    for (int w = 0; w < routes->num_wires; w++){
+        uint64_t v[5];
+        for (int f = 0; f < 5; f++){
+            if (!varint_get(&p, stop, &v[f])){
+                printf("Error: %s is truncated at wire %d.\n", filename, w);
+                return false;
             }
         }
+        long long startx = (long long)v[0], starty = (long long)v[1];
+        long long endx = startx + unzigzag(v[2]), endy = starty + unzigzag(v[3]);
+        bool vertical_first = v[4] & 1;
+        long long bend = (vertical_first ? starty : startx) + unzigzag(v[4] >> 1);
+        if (startx >= dim_x || starty >= dim_y || endx < 0 || endx >= dim_x || endy < 0 || endy >= dim_y ||
+            bend < 0 || bend >= (vertical_first ? dim_y : dim_x)){
+            printf("Error: %s: wire %d leaves the %dx%d grid.\n", filename, w, dim_y, dim_x);
+            return false;
+        }
+        wire_t wire = {(int)startx, (int)starty, (int)endx, (int)endy, (int)bend, vertical_first};
+        wire_store(routes, w, wire);
+    }
+    if (p != stop){
+        printf("Error: %s has data after the last wire.\n", filename);
+        return false;
     }
+    return true;
 }
 
-// clear the costs in the cost array along the existing route
-static void clear_cost(wire_t wire, cost_t *costs, int dim_x, int dim_y){
-    //printf("ENTERING CLEAR_COST......\n");
-
-    int x_step, y_step;
+// the routes of a route file, in file order
+static bool load_routes(const char *filename, int dim_x, int dim_y, wires_t *routes, int num_threads){
+    const char *base;
+    size_t size;
+    if (!map_file(filename, &base, &size)) return false;
 
-    if (wire.bend_1){
-        if (wire.startx == wire.bend_1x){
-            // vertical from start to bend 1
-            if (wire.starty < wire.bend_1y){
-                for (y_step = wire.starty; y_step < wire.bend_1y; y_step++){
-                    costs[wire.startx + dim_x * y_step] -= 1;
-                }
-            } else{
-                for (y_step = wire.starty; y_step > wire.bend_1y; y_step--){
-                    costs[wire.startx + dim_x * y_step] -= 1;
-                }
-            }
+    bool ok;
+    if (size >= 4 && memcmp(base, WIREFILE_ROUTES_MAGIC, 4) == 0){
+        ok = load_routes_bin(filename, base, base + size, dim_x, dim_y, routes);
+    } else{
+        ok = load_routes_text(filename, base, base + size, dim_x, dim_y, routes, num_threads);
+    }
+    munmap((void*)base, size);
+    return ok;
+}
 
-            if (wire.bend_2){
-                // horizontal until bend 2
-                if (wire.bend_1x < wire.bend_2x){
-                    for (x_step = wire.bend_1x; x_step < wire.bend_2x; x_step++){
-                        //printf("index in cost arr: %d\n", step + dim_y * wires[i].starty);
-                        costs[x_step + dim_x * wire.bend_1y] -= 1;
-                    }
-                } else{
-                    for (x_step = wire.bend_1x; x_step > wire.bend_2x; x_step--){
-                        //printf("index in cost arr: %d\n", step + dim_y * wires[i].starty);
-                        costs[x_step + dim_x * wire.bend_1y] -= 1;
-                    }
-                }
+// the endpoints of a wire, in the direction that sorts first
+typedef struct {
+    int x0, y0, x1, y1;
+} endpoints_t;
 
-                // vertical from bend 2 to end
-                if (wire.bend_2y < wire.endy){
-                    for (y_step = wire.bend_2y; y_step <= wire.endy; y_step++){
-                        costs[wire.bend_2x + dim_x * y_step] -= 1;
-                    }
-                } else {
-                    for (y_step = wire.bend_2y; y_step >= wire.endy; y_step--){
-                        costs[wire.bend_2x + dim_x * y_step] -= 1;
-                    }
-                }
-            } else{
-                // only bend 1
+static inline endpoints_t wire_endpoints(wire_t wire){
+    endpoints_t e = {wire.startx, wire.starty, wire.endx, wire.endy};
+    if (e.x1 < e.x0 || (e.x1 == e.x0 && e.y1 < e.y0)){
+        std::swap(e.x0, e.x1);
+        std::swap(e.y0, e.y1);
+    }
+    return e;
+}
 
-                // horizontal from bend 1 to end
-                if (wire.bend_1x < wire.endx){
-                    for (x_step = wire.bend_1x; x_step <= wire.endx; x_step++){
-                        //printf("index in cost arr: %d\n", step + dim_y * wires[i].starty);
-                        costs[x_step + dim_x * wire.bend_1y] -= 1;
-                    }
-                } else{
-                    for (x_step = wire.bend_1x; x_step >= wire.endx; x_step--){
-                        //printf("index in cost arr: %d\n", step + dim_y * wires[i].starty);
-                        costs[x_step + dim_x * wire.bend_1y] -= 1;
-                    }
-                }
-            }
+static inline bool endpoints_less(const endpoints_t &a, const endpoints_t &b){
+    if (a.x0 != b.x0) return a.x0 < b.x0;
+    if (a.y0 != b.y0) return a.y0 < b.y0;
+    if (a.x1 != b.x1) return a.x1 < b.x1;
+    return a.y1 < b.y1;
+}
 
-        } else if (wire.starty == wire.bend_1y){
-            // horizontal from start to bend 1
-            if (wire.startx < wire.bend_1x){
-                for (x_step = wire.startx; x_step < wire.bend_1x; x_step++){
-                    //printf("index in cost arr: %d\n", step + dim_y * wires[i].starty);
-                    costs[x_step + dim_x * wire.starty] -= 1;
-                }
-            } else{
-                for (x_step = wire.startx; x_step > wire.bend_1x; x_step--){
-                    //printf("index in cost arr: %d\n", step + dim_y * wires[i].starty);
-                    costs[x_step + dim_x * wire.starty] -= 1;
-                }
-            }
+static inline bool endpoints_equal(const endpoints_t &a, const endpoints_t &b){
+    return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
 
-            if (wire.bend_2){
-                // vertical from bend 1 to bend 2
-                if (wire.bend_1y < wire.bend_2y){
-                    for (y_step = wire.bend_1y; y_step < wire.bend_2y; y_step++){
-                        costs[wire.bend_1x + dim_x * y_step] -= 1;
-                    }
-                } else{
-                    for (y_step = wire.bend_1y; y_step > wire.bend_2y; y_step--){
-                        costs[wire.bend_1x + dim_x * y_step] -= 1;
-                    }
-                }
+// every wire of the netlist has exactly one route. wireroute writes them in
+// netlist order, which is checked first; any other order is matched by
+// sorting both sides.
+static bool check_endpoints(const char *filename, const wires_t *wires, const wires_t *routes, int num_threads){
+    int n = wires->num_wires, mismatched = 0;
+    #pragma omp parallel for num_threads(num_threads) schedule(static) reduction(+: mismatched)
+    for (int w = 0; w < n; w++){
+        mismatched += !endpoints_equal(wire_endpoints(wire_load(wires, w)), wire_endpoints(wire_load(routes, w)));
+    }
+    if (mismatched == 0) return true;
 
-                // horizontal from bend 2 to end
-                if (wire.bend_2x < wire.endx){
-                    for (x_step = wire.bend_2x; x_step <= wire.endx; x_step++){
-                        costs[x_step + dim_x * wire.bend_2y] -= 1;
-                    }
-                } else {
-                    for (x_step = wire.bend_2x; x_step >= wire.endx; x_step--){
-                        costs[x_step + dim_x * wire.bend_2y] -= 1;
-                    }
-                }
-            } else{
-                // only bend 1
+    endpoints_t *want = (endpoints_t*)malloc(std::max(n, 1) * sizeof(endpoints_t));
+    endpoints_t *have = (endpoints_t*)malloc(std::max(n, 1) * sizeof(endpoints_t));
+    for (int w = 0; w < n; w++){
+        want[w] = wire_endpoints(wire_load(wires, w));
+        have[w] = wire_endpoints(wire_load(routes, w));
+    }
+    std::sort(want, want + n, endpoints_less);
+    std::sort(have, have + n, endpoints_less);
+
+    bool ok = true;
+    for (int w = 0; w < n && ok; w++){
+        if (endpoints_equal(want[w], have[w])) continue;
+        // the smaller one is missing on the other side
+        ok = false;
+        if (endpoints_less(want[w], have[w])){
+            printf("Error: %s: no route for wire (%d, %d) -> (%d, %d).\n",
+                   filename, want[w].x0, want[w].y0, want[w].x1, want[w].y1);
+        } else{
+            printf("Error: %s: route (%d, %d) -> (%d, %d) is not a wire of the netlist.\n",
+                   filename, have[w].x0, have[w].y0, have[w].x1, have[w].y1);
+        }
+    }
+    free(want);
+    free(have);
+    return ok;
+}
 
-                // vertical from bend 1 to end
-                if (wire.bend_1y < wire.endy){
-                    for (y_step = wire.bend_1y; y_step <= wire.endy; y_step++){
-                        costs[wire.bend_1x + dim_x * y_step] -= 1;
-                    }
-                } else{
-                    for (y_step = wire.bend_1y; y_step >= wire.endy; y_step--){
-                        costs[wire.bend_1x + dim_x * y_step] -= 1;
-                    }
-                }
-            }
-        } 
-    } else{
-        // no bends
-        if (wire.startx == wire.endx){
-            // vertical line from start to end
-            if (wire.starty < wire.endy){
-                for (y_step = wire.starty; y_step <= wire.endy; y_step++){
-                    costs[wire.startx + dim_x * y_step] -= 1;
-                }
-            } else{
-                for (y_step = wire.starty; y_step >= wire.endy; y_step--){
-                    costs[wire.startx + dim_x * y_step] -= 1;
-                }
-            }
+// route_walk operation counting every cell of a route, from any thread
+typedef struct {
+    int *cells;
+    int dim_x;
 
-            //printf("wire #%d with cost %d\n", i, wires[i].total_cost);
-        } else if (wire.starty == wire.endy){
-            if (wire.startx < wire.endx){
-                for (x_step = wire.startx; x_step <= wire.endx; x_step++){
-                    costs[x_step + dim_x * wire.starty] -= 1;
-                }
-            } else{
-                for (x_step = wire.startx; x_step >= wire.endx; x_step--){
-                    costs[x_step + dim_x * wire.starty] -= 1;
-                }
-            }
+    void row(int x, int y, int dir, int len){
+        int *c = &cells[x + (size_t)dim_x * y];
+        for (int j = 0; j < len; j++){
+            #pragma omp atomic
+            c[j * dir]++;
+        }
+    }
+    void column(int x, int y, int dir, int len){
+        int *c = &cells[x + (size_t)dim_x * y];
+        for (int j = 0; j < len; j++){
+            #pragma omp atomic
+            c[(ptrdiff_t)j * dir * dim_x]++;
+        }
+    }
+    void cell(int x, int y){
+        #pragma omp atomic
+        cells[x + (size_t)dim_x * y]++;
+    }
+} route_count_t;
+
+// one row of a text cost file against the occupancy, false with the problem in error
+static bool check_cost_row(const char **pp, const char *end, const int *occupancy, int row, int dim_x,
+                           char *error, size_t error_size){
+    const char *p = *pp;
+    int col = 0;
+    long long v;
+    for (int r; (r = parse_int(&p, end, &v)) != 0; col++){
+        if (r < 0){
+            snprintf(error, error_size, "expected integers");
+            *pp = next_line(p, end);
+            return false;
+        }
+        if (col < dim_x && v != occupancy[col]){
+            snprintf(error, error_size, "cell (%d, %d) is %lld, the routes give %d", col, row, v, occupancy[col]);
+            *pp = next_line(p, end);
+            return false;
         }
     }
+    *pp = (p < end) ? p + 1 : end;
+    if (col != dim_x){
+        snprintf(error, error_size, "expected %d values, found %d", dim_x, col);
+        return false;
+    }
+    return true;
 }
 
-// perform the wire routing iterations (sequential for now)
-static void routing(wire_t *wires, cost_t *costs, int dim_x, int dim_y, 
-                    int num_wires, int N, int num_threads){
-    // loop iterations for improvement (inside which each wire is checked)
-    //printf("ENTERING ROUTING...\n");
-    //float P = 0.1;
-    for (int i = 0; i < N; i++){
-        // loop each wire
-
-        // PARALLELIZE cross wires (num_wires / num_threads = wires taken care by one thread)
-        // SHARED: costs, wires
-
-        int WIRES_PER_THREAD = (num_wires + num_threads - 1) / num_threads;
-        omp_set_num_threads(num_threads);
-        int wid;
-        #pragma omp parallel for schedule(static, WIRES_PER_THREAD) shared(costs, wires)
-        for (wid = 0; wid < num_wires; wid++){
-
-            int ori_cost;
-            #pragma omp critical
-            {
-                ori_cost = cost_calc(wires[wid], costs, dim_x, dim_y);
+static bool check_costs_text(const char *filename, const char *base, const char *end,
+                             const int *occupancy, int dim_x, int dim_y, int num_threads){
+    const char *p = base;
+    long long header[2];
+    if (parse_ints(&p, end, header, 2) != 2 || header[0] != dim_y || header[1] != dim_x){
+        printf("Error: %s:1: expected the grid dimensions %d %d.\n", filename, dim_y, dim_x);
+        return false;
+    }
+
+    const char *body = p;
+    parse_chunk_t *chunks = (parse_chunk_t*)calloc(num_threads, sizeof(parse_chunk_t));
+    int team = 1;
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int t = omp_get_thread_num();
+        #pragma omp single
+        team = omp_get_num_threads();
+
+        chunk_lines(chunks, t, team, base, body, end, 2);
+
+        parse_chunk_t *chunk = &chunks[t];
+        int line = chunk->first_line, row = chunk->first_item;
+        for (const char *q = chunk->lo; q < chunk->hi && !chunk->error_line; line++){
+            const char *first = skip_blanks(q, chunk->hi);
+            if (first == chunk->hi || *first == '\n'){
+                q = next_line(q, chunk->hi);
+                continue;
             }
-            // printf("LOOP THREAD #%d\n", wid);
-            // printf("original cost: %d\n", ori_cost);
-
-            wire_t cur_wire = wires[wid];
-            int total_routes = abs(cur_wire.endx - cur_wire.startx) + abs(cur_wire.endy - cur_wire.starty);
-            int route_len = 1 + total_routes;
-            wire_t *all_possible = (wire_t*)malloc(total_routes * sizeof(wire_t));
-            wire_t *next_possible = &all_possible[0];
-
-            int min_cost = ori_cost;
-            wire_t best_route;
-
-            // clear the current costs, updates costs, needs synchronize
-            #pragma omp critical
-            {   
-                clear_cost(wires[wid], costs, dim_x, dim_y);
+            if (row >= dim_y){
+                chunk->error_line = line;
+                snprintf(chunk->error, sizeof(chunk->error), "more than %d rows", dim_y);
+            } else if (!check_cost_row(&q, chunk->hi, occupancy + (size_t)dim_x * row, row, dim_x,
+                                       chunk->error, sizeof(chunk->error))){
+                chunk->error_line = line;
             }
+            row++;
+        }
+    }
 
-            // calculate the current path cost, set to minimum
-            best_route = cur_wire;
-
-            int x_step, y_step;
-            int cur_cost;
-
-            // calculate costs of other alternatives, compare
-            // skipped for straight line
-            if (!on_straight_line(cur_wire)){
-
-                // horizontal travel first
-                if (cur_wire.startx < cur_wire.endx){
-                    // travel horizontally does not include itself
-                    // loops for all horizontal possibilities
-                    // PARALLELIZE calculating all possible routes
-                    // SHARED: min_cost, best_route (specific to that wire)
-                    for (x_step = cur_wire.startx; x_step < cur_wire.endx; x_step++){
-                        wire_t new_w;
-
-                        new_w.startx = cur_wire.startx;
-                        new_w.starty = cur_wire.starty;
-
-                        new_w.bend_1 = true;
-                        new_w.bend_1x = x_step+1;
-                        new_w.bend_1y = cur_wire.starty;
-
-                        new_w.endx = cur_wire.endx;
-                        new_w.endy = cur_wire.endy;
-                        new_w.total_cost = 0;
-
-                        //check if second bend is needed
-                        // second bend would be vertical line
-                        if (new_w.bend_1x != new_w.endx){
-                            // first bend is not on same line as end points
-                            new_w.bend_2 = true;
-
-                            //second bend has to have the same y value as the end point
-                            new_w.bend_2y = new_w.endy;
-                            new_w.bend_2x = new_w.bend_1x;
-                        } else{
-                            new_w.bend_2 = false;
-                        }
-
-                        //SHARED FOR every route: all_possible
-                        *next_possible = new_w;
-                        next_possible = next_possible + 1;
-
-                        int cur_cost;
-                        #pragma omp critical
-                        {
-                            //print_cost(dim_x, dim_y, costs);
-                            cur_cost = cost_calc(new_w, costs, dim_x, dim_y) + route_len;
-                            // printf("travel horizontally first cost: %d\n", cur_cost);
-                            // printf("bend 1: (%d, %d)\n", new_w.bend_1x, new_w.bend_1y);
-                            // if (new_w.bend_2){
-                            //     printf("bend 2: (%d, %d)\n", new_w.bend_2x, new_w.bend_2y);
-                            // }
-                            if (cur_cost < min_cost){
-                                min_cost = cur_cost;
-                                best_route = new_w;
-                            }
-                        }
-                    }
-                } else{
-                    for (x_step = cur_wire.startx; x_step > cur_wire.endx; x_step--){
-                        wire_t new_w;
-
-                        new_w.startx = cur_wire.startx;
-                        new_w.starty = cur_wire.starty;
-
-                        new_w.bend_1 = true;
-                        new_w.bend_1x = x_step-1;
-                        new_w.bend_1y = cur_wire.starty;
-
-                        new_w.endx = cur_wire.endx;
-                        new_w.endy = cur_wire.endy;
-                        new_w.total_cost = 0;
-
-                        //check if second bend is needed
-                        // second bend would be vertical line
-                        if (new_w.bend_1x != new_w.endx){
-                            // first bend is not on same line as end points
-                            new_w.bend_2 = true;
-
-                            //second bend has to have the same y value as the end point
-                            new_w.bend_2y = new_w.endy;
-                            new_w.bend_2x = new_w.bend_1x;
-                        } else{
-                            new_w.bend_2 = false;
-                        }
-
-                        //SHARED FOR every route: all_possible
-                        *next_possible = new_w;
-                        next_possible = next_possible + 1;
-
-                        #pragma omp critical
-                        {   
-                            //print_cost(dim_x, dim_y, costs);
-                            cur_cost = cost_calc(new_w, costs, dim_x, dim_y);
-                            // printf("travel horizontally first cost: %d\n", cur_cost) + route_len;
-                            // printf("bend 1: (%d, %d)\n", new_w.bend_1x, new_w.bend_1y);
-                            // printf("bend 2: (%d, %d)\n", new_w.bend_2x, new_w.bend_2y);
-                            if (cur_cost < min_cost){
-                                min_cost = cur_cost;
-                                best_route = new_w;
-                            }
-                        }
-                    }
-                }
+    bool ok = chunks_ok(chunks, team, filename);
+    int found = chunks[team - 1].first_item + chunks[team - 1].num_items;
+    if (ok && found < dim_y){
+        printf("Error: %s: expected %d rows, found %d.\n", filename, dim_y, found);
+        ok = false;
+    }
+    free(chunks);
+    return ok;
+}
 
-                // horizontal travel first
-
-                if (cur_wire.starty < cur_wire.endy){
-                    // travel horizontally does not include itself
-                    // loop for all possibilities traveling vertically
-                    for (y_step = cur_wire.starty; y_step < cur_wire.endy; y_step++){
-
-                        wire_t new_w;
-                        new_w.startx = cur_wire.startx;
-                        new_w.starty = cur_wire.starty;
-
-                        new_w.bend_1 = true;
-                        new_w.bend_1x = cur_wire.startx;
-                        new_w.bend_1y = y_step+1;
-
-                        new_w.endx = cur_wire.endx;
-                        new_w.endy = cur_wire.endy;
-                        new_w.total_cost = 0;
-
-                        //check if second bend is needed
-                        // second bend would be vertical line
-                        if (new_w.bend_1x != new_w.endx){
-                            // first bend is not on same line as end points
-                            new_w.bend_2 = true;
-
-                            //second bend has to have the same y value as the end point
-                            new_w.bend_2y = new_w.bend_1y;
-                            new_w.bend_2x = new_w.endx;
-                        } else{
-                            new_w.bend_2 = false;
-                        }
-
-                        //SHARED FOR every route: all_possible
-                        *next_possible = new_w;
-                        next_possible = next_possible + 1;
-
-                        #pragma omp critical
-                        {
-                            //print_cost(dim_x, dim_y, costs);
-                            cur_cost = cost_calc(new_w, costs, dim_x, dim_y);
-                            // printf("travel vertically first cost: %d\n", cur_cost) + route_len;
-                            // printf("bend 1: (%d, %d)\n", new_w.bend_1x, new_w.bend_1y);
-                            // printf("bend 2: (%d, %d)\n", new_w.bend_2x, new_w.bend_2y);
-                            if (cur_cost < min_cost){
-                                min_cost = cur_cost;
-                                best_route = new_w;
-                            }
-                        } 
-                    }
-                } else{
-                    for (y_step = cur_wire.starty; y_step > cur_wire.endy; y_step--){
-
-                        wire_t new_w;
-                        new_w.startx = cur_wire.startx;
-                        new_w.starty = cur_wire.starty;
-
-                        new_w.bend_1 = true;
-                        new_w.bend_1x = cur_wire.startx;
-                        new_w.bend_1y = y_step-1;
-
-                        new_w.endx = cur_wire.endx;
-                        new_w.endy = cur_wire.endy;
-                        new_w.total_cost = 0;
-
-                        //check if second bend is needed
-                        // second bend would be vertical line
-                        if (new_w.bend_1x != new_w.endx){
-                            // first bend is not on same line as end points
-                            new_w.bend_2 = true;
-
-                            //second bend has to have the same y value as the end point
-                            new_w.bend_2y = new_w.bend_1y;
-                            new_w.bend_2x = new_w.endx;
-                        } else{
-                            new_w.bend_2 = false;
-                        }
-
-                        //SHARED FOR every route: all_possible
-                        *next_possible = new_w;
-                        next_possible = next_possible + 1;
-
-                        #pragma omp critical
-                        {
-                            //print_cost(dim_x, dim_y, costs);
-                            cur_cost = cost_calc(new_w, costs, dim_x, dim_y) + route_len;
-                            // printf("travel vertically first cost: %d\n", cur_cost);
-                            // printf("bend 1: (%d, %d)\n", new_w.bend_1x, new_w.bend_1y);
-                            // printf("bend 2: (%d, %d)\n", new_w.bend_2x, new_w.bend_2y);
-                            if (cur_cost < min_cost){
-                                min_cost = cur_cost;
-                                best_route = new_w;
-                            } 
-                        }
-                    }
+// run-length rows: every run has to match the occupancy cell by cell
+static bool check_costs_bin(const char *filename, const char *base, const char *end,
+                            const int *occupancy, int dim_x, int dim_y){
+    const unsigned char *p = (const unsigned char*)base + 4, *stop = (const unsigned char*)end;
+    uint64_t header[3];
+    for (int f = 0; f < 3; f++){
+        if (!varint_get(&p, stop, &header[f])){
+            printf("Error: %s is truncated.\n", filename);
+            return false;
+        }
+    }
+    if (header[0] != WIREFILE_VERSION || header[1] != (uint64_t)dim_y || header[2] != (uint64_t)dim_x){
+        printf("Error: %s: expected version %d and a %dx%d grid.\n", filename, WIREFILE_VERSION, dim_y, dim_x);
+        return false;
+    }
+
+    for (int row = 0; row < dim_y; row++){
+        const int *cells = occupancy + (size_t)dim_x * row;
+        for (int col = 0; col < dim_x; ){
+            uint64_t value, run;
+            if (!varint_get(&p, stop, &value) || !varint_get(&p, stop, &run) ||
+                run == 0 || run > (uint64_t)(dim_x - col)){
+                printf("Error: %s is truncated or corrupt in row %d.\n", filename, row);
+                return false;
+            }
+            for (int c = col; c < col + (int)run; c++){
+                if (cells[c] != (int)value){
+                    printf("Error: %s: cell (%d, %d) is %d, the routes give %d.\n",
+                           filename, c, row, (int)value, cells[c]);
+                    return false;
                 }
             }
+            col += (int)run;
+        }
+    }
+    if (p != stop){
+        printf("Error: %s has data after the last row.\n", filename);
+        return false;
+    }
+    return true;
+}
 
-            int r = rand() % 10 + 1;
-            if (r != 1){
-                //randomly choose one from possibility array
-                int choose = rand() % total_routes + 1;
-                best_route = all_possible[choose-1];
-            }
+static bool check_costs(const char *filename, const int *occupancy, int dim_x, int dim_y, int num_threads){
+    const char *base;
+    size_t size;
+    if (!map_file(filename, &base, &size)) return false;
 
-            #pragma omp critical
-            {
-                
-                wires[wid] = best_route;
-                add_cost(wires[wid], costs, dim_x, dim_y);
-                // printf("BEST ROUTE FOUND: \n");
-                // printf("BEST bend 1: (%d, %d)\n", wires[wid].bend_1x, wires[wid].bend_1y);
-                // printf("BEST bend 2: (%d, %d)\n", wires[wid].bend_2x, wires[wid].bend_2y);
-                // print_cost(dim_x, dim_y, costs);
-                // printf("EXISTING THIS THREAD");
-            }
+    bool ok;
+    if (size >= 4 && memcmp(base, WIREFILE_COSTS_MAGIC, 4) == 0){
+        ok = check_costs_bin(filename, base, base + size, occupancy, dim_x, dim_y);
+    } else{
+        ok = check_costs_text(filename, base, base + size, occupancy, dim_x, dim_y, num_threads);
+    }
+    munmap((void*)base, size);
+    return ok;
+}
 
-            free(all_possible);
+// validate the route and cost files written for the netlist in wires
+static bool validate_outputs(const wires_t *wires, int dim_x, int dim_y,
+                             const char *routes_filename, const char *costs_filename, int num_threads){
+    wires_t routes;
+    wires_alloc(&routes, wires->num_wires);
+    bool ok = load_routes(routes_filename, dim_x, dim_y, &routes, num_threads) &&
+              check_endpoints(routes_filename, wires, &routes, num_threads);
+
+    if (ok){
+        int *occupancy = (int*)calloc((size_t)dim_x * dim_y, sizeof(int));
+        route_count_t op = {occupancy, dim_x};
+        #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 64) firstprivate(op)
+        for (int w = 0; w < routes.num_wires; w++){
+            route_walk(wire_load(&routes, w), op);
         }
+        ok = check_costs(costs_filename, occupancy, dim_x, dim_y, num_threads);
+        free(occupancy);
+    }
+    wires_free(&routes);
+    return ok;
+}
+
+// a JSON string, quoted and escaped
+static void json_string(FILE *out, const char *s){
+    fputc('"', out);
+    for (; *s; s++){
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') fprintf(out, "\\%c", ch);
+        else if (ch < 0x20) fprintf(out, "\\u%04x", ch);
+        else fputc(ch, out);
     }
+    fputc('"', out);
+}
+
+static void json_counters(FILE *out, const counters_t *c){
+    fprintf(out, "{\"wires\": %lld, \"candidates\": %lld, \"cells_read\": %lld, \"cells_written\": %lld, "
+                 "\"improved\": %lld, \"randomized\": %lld, \"rerouted\": %lld, \"lock_wait_s\": %.6f, \"lock_hold_s\": %.6f, "
+                 "\"busy_s\": %.6f}",
+            c->wires, c->candidates, c->cells_read, c->cells_written,
+            c->improved, c->randomized, c->rerouted, c->lock_wait, c->lock_hold, c->busy);
+}
+
+// the -j report: the settings of the run (names[i] = values[i]), its times,
+// the counters of every thread and their total, and every iteration
+static bool write_report(const char *filename, const char **names, const char **values, int num_settings,
+                         const stats_t *stats, int dim_x, int dim_y, int num_wires, int cell_bits,
+                         double init_time, double compute_time, double output_time){
+    FILE *out = fopen(filename, "w");
+    if (!out) {
+        printf("Error: Cannot write %s.\n", filename);
+        return false;
+    }
+    static const char *mode_names[] = {"across", "atomic", "within", "color", "region"};
+
+    fprintf(out, "{\n  \"settings\": {");
+    for (int i = 0; i < num_settings; i++){
+        fprintf(out, "%s\n    ", i ? "," : "");
+        json_string(out, names[i]);
+        fprintf(out, ": ");
+        json_string(out, values[i]);
+    }
+    fprintf(out, "\n  },\n");
+    fprintf(out, "  \"routed_mode\": \"%s\",\n", mode_names[stats->mode]);
+    fprintf(out, "  \"threads\": %d,\n", stats->num_threads);
+    fprintf(out, "  \"dim_x\": %d,\n  \"dim_y\": %d,\n  \"wires\": %d,\n", dim_x, dim_y, num_wires);
+    fprintf(out, "  \"cell_bits\": %d,\n  \"widenings\": %d,\n", cell_bits, stats->widenings);
+    fprintf(out, "  \"init_s\": %.6f,\n  \"compute_s\": %.6f,\n  \"output_s\": %.6f,\n",
+            init_time, compute_time, output_time);
+    fprintf(out, "  \"congestion_threshold\": %d,\n", stats->threshold);
+    fprintf(out, "  \"initial_cost\": %lld,\n  \"initial_max_occupancy\": %d,\n",
+            stats->initial.squared, stats->initial_max);
+    fprintf(out, "  \"initial_occupancy\": %lld,\n  \"initial_cells_over\": %lld,\n",
+            stats->initial.occupancy, stats->initial.over);
+    fprintf(out, "  \"final_cost\": %lld,\n  \"final_max_occupancy\": %d,\n",
+            stats->final.squared, stats->final_max);
+    fprintf(out, "  \"final_occupancy\": %lld,\n  \"final_cells_over\": %lld,\n",
+            stats->final.occupancy, stats->final.over);
+    if (stats->was_restored){
+        // -1: the initial routes
+        fprintf(out, "  \"restored_iteration\": %d,\n", stats->restored);
+    }
+    if (stats->mode == MODE_ATOMIC){
+        fprintf(out, "  \"decisions\": %lld,\n  \"stale_decisions\": %lld,\n  \"stale_drift\": %lld,\n",
+                stats->decisions, stats->stale_decisions, stats->stale_drift);
+    }
+
+    counters_t total;
+    memset(&total, 0, sizeof(total));
+    double busy_max = 0;
+    fprintf(out, "  \"per_thread\": [");
+    for (int t = 0; t < stats->num_threads; t++){
+        const counters_t *c = &stats->counters[t];
+        fprintf(out, "%s\n    ", t ? "," : "");
+        json_counters(out, c);
+        total.wires += c->wires;
+        total.candidates += c->candidates;
+        total.cells_read += c->cells_read;
+        total.cells_written += c->cells_written;
+        total.improved += c->improved;
+        total.randomized += c->randomized;
+        total.rerouted += c->rerouted;
+        total.lock_wait += c->lock_wait;
+        total.lock_hold += c->lock_hold;
+        total.busy += c->busy;
+        busy_max = std::max(busy_max, c->busy);
+    }
+    fprintf(out, "\n  ],\n  \"total\": ");
+    json_counters(out, &total);
+    fprintf(out, ",\n  \"busy_max_over_mean\": %.4f,\n",
+            total.busy > 0 ? busy_max * stats->num_threads / total.busy : 1.0);
+
+    fprintf(out, "  \"iterations\": [");
+    for (int i = 0; i < stats->num_iters; i++){
+        const iteration_t *iter = &stats->iters[i];
+        fprintf(out, "%s\n    {\"iteration\": %d, \"wall_s\": %.6f, \"random_prob\": %.6f, "
+                     "\"cost\": %lld, \"occupancy\": %lld, \"cells_over\": %lld, "
+                     "\"max_occupancy\": %d, \"rerouted\": %lld}",
+                i ? "," : "", i, iter->wall, iter->prob, iter->quality.squared, iter->quality.occupancy,
+                iter->quality.over, iter->max, iter->rerouted);
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out) == 0;
 }
 
 int main(int argc, const char *argv[]) {
@@ -761,6 +3153,21 @@ int main(int argc, const char *argv[]) {
     int num_of_threads = get_option_int("-n", 1);
     double SA_prob = get_option_float("-p", 0.1f);
     int SA_iters = get_option_int("-i", 5);
+    const char *mode_name = get_option_string("-m", "across");
+    int seed = get_option_int("-s", 0);
+    double SA_decay = get_option_float("-d", 0.5f);
+    double min_gain = get_option_float("-t", 0.001f);
+    const char *objective_name = get_option_string("-c", "sum");
+    const char *format_name = get_option_string("-o", "text");
+    const char *width_name = get_option_string("-w", "auto");
+    const char *layout_name = get_option_string("-l", "rows");
+    const char *kernels_name = get_option_string("-k", "auto");
+    const char *order_name = get_option_string("-r", "input");
+    const char *balance_name = get_option_string("-b", "static");
+    const char *report_filename = get_option_string("-j", NULL);
+    int over_threshold = get_option_int("-q", 1);
+    const char *validate_filename = get_option_string("-validate", NULL);
+    const char *validate_costs = get_option_string("-validate_costs", NULL);
 
     int error = 0;
 
@@ -769,119 +3176,177 @@ int main(int argc, const char *argv[]) {
         error = 1;
     }
 
+    route_mode_t mode = MODE_ACROSS;
+    if (strcmp(mode_name, "across") == 0) {
+        mode = MODE_ACROSS;
+    } else if (strcmp(mode_name, "atomic") == 0) {
+        mode = MODE_ATOMIC;
+    } else if (strcmp(mode_name, "within") == 0) {
+        mode = MODE_WITHIN;
+    } else if (strcmp(mode_name, "color") == 0) {
+        mode = MODE_COLOR;
+    } else if (strcmp(mode_name, "region") == 0) {
+        mode = MODE_REGION;
+    } else {
+        printf("Error: Unknown routing mode %s.\n", mode_name);
+        error = 1;
+    }
+
+    objective_t objective = OBJECTIVE_SUM;
+    if (strcmp(objective_name, "sum") == 0) {
+        objective = OBJECTIVE_SUM;
+    } else if (strcmp(objective_name, "max") == 0) {
+        objective = OBJECTIVE_MAX;
+    } else {
+        printf("Error: Unknown objective %s.\n", objective_name);
+        error = 1;
+    }
+
+    bool binary_output = false;
+    if (strcmp(format_name, "text") == 0) {
+        binary_output = false;
+    } else if (strcmp(format_name, "bin") == 0) {
+        binary_output = true;
+    } else {
+        printf("Error: Unknown output format %s.\n", format_name);
+        error = 1;
+    }
+
+    int width_bits = 0;
+    if (strcmp(width_name, "auto") != 0) {
+        width_bits = atoi(width_name);
+        if (width_bits != 8 && width_bits != 16 && width_bits != 32) {
+            printf("Error: Unknown cell width %s.\n", width_name);
+            error = 1;
+        }
+    }
+
+    grid_layout_t layout = LAYOUT_ROWS;
+    if (strcmp(layout_name, "rows") == 0) {
+        layout = LAYOUT_ROWS;
+    } else if (strcmp(layout_name, "tiles") == 0) {
+        layout = LAYOUT_TILES;
+    } else if (strcmp(layout_name, "dual") == 0) {
+        layout = LAYOUT_DUAL;
+    } else {
+        printf("Error: Unknown grid layout %s.\n", layout_name);
+        error = 1;
+    }
+
+    wire_order_t order = ORDER_INPUT;
+    if (strcmp(order_name, "input") == 0) {
+        order = ORDER_INPUT;
+    } else if (strcmp(order_name, "hilbert") == 0) {
+        order = ORDER_HILBERT;
+    } else if (strcmp(order_name, "morton") == 0) {
+        order = ORDER_MORTON;
+    } else {
+        printf("Error: Unknown wire order %s.\n", order_name);
+        error = 1;
+    }
+
+    balance_t balance = BALANCE_STATIC;
+    if (strcmp(balance_name, "static") == 0) {
+        balance = BALANCE_STATIC;
+    } else if (strcmp(balance_name, "lpt") == 0) {
+        balance = BALANCE_LPT;
+    } else if (strcmp(balance_name, "steal") == 0) {
+        balance = BALANCE_STEAL;
+    } else {
+        printf("Error: Unknown load balancing %s.\n", balance_name);
+        error = 1;
+    }
+
+    if (over_threshold < 0) {
+        printf("Error: Congestion threshold %d is negative.\n", over_threshold);
+        error = 1;
+    }
+
+    const simd_t *simd = simd_select(kernels_name);
+    if (simd == NULL) {
+        printf("Error: Unknown kernels %s, or not supported by this CPU.\n", kernels_name);
+        error = 1;
+    }
+
+    // the cost file written next to the route file, unless named
+    char costs_filename[256] = "";
+    if (validate_filename && validate_costs) {
+        snprintf(costs_filename, sizeof(costs_filename), "%s", validate_costs);
+    } else if (validate_filename) {
+        const char *slash = strrchr(validate_filename, '/');
+        const char *name = slash ? slash + 1 : validate_filename;
+        if (strncmp(name, "output_", 7) == 0 && strlen(validate_filename) + 1 < sizeof(costs_filename)) {
+            snprintf(costs_filename, sizeof(costs_filename), "%.*scost_%s",
+                     (int)(name - validate_filename), validate_filename, name + 7);
+        } else {
+            printf("Error: %s does not start with output_, name the cost file with -validate_costs.\n",
+                   validate_filename);
+            error = 1;
+        }
+    }
+
     if (error) {
         show_help(argv[0]);
         return 1;
     }
 
+    if (validate_filename) {
+        auto validate_start = Clock::now();
+        printf("Validating %s and %s against %s with %d threads\n",
+               validate_filename, costs_filename, input_filename, num_of_threads);
+        int dim_x, dim_y;
+        wires_t wires;
+        bool ok = load_netlist(input_filename, &dim_x, &dim_y, &wires, num_of_threads);
+        if (ok) {
+            ok = validate_outputs(&wires, dim_x, dim_y, validate_filename, costs_filename, num_of_threads);
+            wires_free(&wires);
+        }
+        printf("Correctness: %s\n", ok ? "True" : "False");
+        printf("Validation Time: %lf.\n", duration_cast<dsec>(Clock::now() - validate_start).count());
+        return ok ? 0 : 1;
+    }
+
     printf("Number of threads: %d\n", num_of_threads);
     printf("Probability parameter for simulated annealing: %lf.\n", SA_prob);
     printf("Number of simulated annealing iterations: %d\n", SA_iters);
+    printf("Simulated annealing decay: %lf, convergence threshold: %lf\n", SA_decay, min_gain);
+    printf("Routing mode: %s\n", mode_name);
+    printf("Random seed: %d\n", seed);
+    printf("Objective: %s\n", objective_name);
+    printf("Output format: %s\n", format_name);
+    printf("Kernels: %s\n", simd->name);
+    printf("Wire order: %s\n", order_name);
+    printf("Load balancing: %s\n", balance_name);
     printf("Input file: %s\n", input_filename);
 
-    FILE *input = fopen(input_filename, "r");
-
-    if (!input) {
-        printf("Unable to open file: %s.\n", input_filename);
-        return 1;
-    }
-
     int dim_x, dim_y;
     int num_of_wires;
 
-    fscanf(input, "%d %d\n", &dim_y, &dim_x);
-    fscanf(input, "%d\n", &num_of_wires);
-
-    wire_t *wires = (wire_t *)calloc(num_of_wires, sizeof(wire_t));
+    wires_t wires;
     /* Read the grid dimension and wire information from file */
     printf("about to enter loop for wires......\n");
-    for (int widx = 0; widx < num_of_wires; widx++){
-        int cur_startx, cur_starty, cur_endx, cur_endy;
-        fscanf(input, "%d %d %d %d\n", &cur_startx, &cur_starty, &cur_endx, &cur_endy);
-        // printf("start x: %d. start y: %d \n", cur_startx, cur_starty);
-        // printf("end x: %d. end y: %d \n", cur_endx, cur_endy);
-
-        wires[widx].startx = cur_startx;
-        wires[widx].starty = cur_starty;
-        wires[widx].endx = cur_endx;
-        wires[widx].endy = cur_endy;
-
-        wires[widx].bend_1 = false;
-        wires[widx].bend_2 = false;
+    if (!load_netlist(input_filename, &dim_x, &dim_y, &wires, num_of_threads)){
+        return 1;
+    }
+    num_of_wires = wires.num_wires;
 
-        wires[widx].total_cost = 0;
-        //printf("start x: %d. start y: %d \n", wires[widx].startx, wires[widx].starty);
+    int *input_index = NULL;
+    if (order != ORDER_INPUT) {
+        input_index = wires_order(&wires, dim_x, dim_y, order, num_of_threads);
     }
 
-    cost_t *costs = (cost_t *)calloc(dim_x * dim_y, sizeof(cost_t));
-    /* Initialize cost matrix */
-    for (int i = 0; i < dim_x * dim_y; i++){
-        costs[i] = 0;
+    // no cell can hold more than every wire
+    grid_t grid;
+    if (width_bits == 0) {
+        width_bits = (num_of_wires <= UINT8_MAX) ? 8 : (num_of_wires <= UINT16_MAX) ? 16 : 32;
     }
+    grid.width = (width_bits == 8) ? CELL_8 : (width_bits == 16) ? CELL_16 : CELL_32;
+    grid.layout = layout;
 
     printf("about to enter loop for initialization......\n");
     /* Initailize additional data structures needed in the algorithm */
-    for (int i = 0; i < num_of_wires; i++){
-        //printf("new wire #%d\n", i);
-        if (wires[i].startx == wires[i].endx){
-            
-            int y_min = std::min(wires[i].starty, wires[i].endy);
-            int y_max = std::max(wires[i].starty, wires[i].endy);
-
-            for (int step = y_min; step <= y_max; step++){
-                //printf("index in cost arr: %d\n", wires[i].startx + dim_y * step);
-                costs[wires[i].startx + dim_x * step] += 1;
-                // printf("index: (%d, %d), cost: %d\n", wires[i].startx, step, 
-                //         costs[wires[i].startx + dim_y * step]);
-            }
-
-            //printf("wire #%d with cost %d\n", i, wires[i].total_cost);
-        } else if (wires[i].starty == wires[i].endy){
-            int x_min = std::min(wires[i].startx, wires[i].endx);
-            int x_max = std::max(wires[i].startx, wires[i].endx);
-
-            for (int step = x_min; step <= x_max; step++){
-                //printf("index in cost arr: %d\n", step + dim_y * wires[i].starty);
-                costs[step + dim_x * wires[i].starty] += 1;
-                // printf("index: (%d, %d), cost: %d\n", step, wires[i].starty, 
-                //         costs[step + dim_y * wires[i].starty]);
-            }
-
-            //printf("wire #%d with cost %d\n", i, wires[i].total_cost);
-        } else{
-            // needs to bend somewhere
-            wires[i].bend_1 = true;
-            wires[i].bend_1x = wires[i].endx;
-            wires[i].bend_1y = wires[i].starty;
-
-            int x_min = std::min(wires[i].startx, wires[i].bend_1x);
-            int x_max = std::max(wires[i].startx, wires[i].bend_1x);
-
-            // horizontal line, x is changing
-            for (int step = x_min; step <= x_max; step++){
-                costs[step + dim_x * wires[i].starty] += 1;
-                // printf("index: (%d, %d), cost: %d\n", step, wires[i].starty,
-                //         costs[step + dim_x * wires[i].starty]);
-            }
-
-            int y_min, y_max;
-            if (wires[i].bend_1y < wires[i].endy){
-                y_min = wires[i].bend_1y + 1;
-                y_max = wires[i].endy;
-            } else{
-                y_max = wires[i].bend_1y - 1;
-                y_min = wires[i].endy;
-            }
-
-            // vertical line, y is changing
-            for (int step = y_min; step <= y_max; step++){
-                costs[wires[i].bend_1x + dim_x * step] += 1;
-                // printf("index: (%d, %d), cost: %d\n", wires[i].bend_1x, step,
-                //         costs[wires[i].bend_1x + dim_x * step]);
-            }
-        }
-        
-    }
+    grid_build(&grid, &wires, dim_x, dim_y, num_of_threads);
+    printf("Cell width: %d bits, layout: %s\n", cell_bits(grid.width), layout_name);
 
     /* Conduct initial wire placement */
     
@@ -898,184 +3363,70 @@ int main(int argc, const char *argv[]) {
      * Don't use global variables.
      * Use OpenMP to parallelize the algorithm.
      */
-    int N = 5;
-    routing(wires, costs, dim_x, dim_y, num_of_wires, N, num_of_threads);
+    anneal_t anneal = {SA_iters, SA_prob, SA_decay, min_gain};
+    stats_t stats;
+    routing(&wires, &grid, dim_x, dim_y, num_of_wires, anneal, num_of_threads, mode, objective, (uint64_t)seed, simd, balance,
+            over_threshold, &stats);
     // printf("ROUTING DONE!!!");
-    // print_cost(dim_x, dim_y, costs);
+    // GRID_VISIT(&grid, dim_x, dim_y, print_cost(dim_x, dim_y, view));
 
     compute_time += duration_cast<dsec>(Clock::now() - compute_start).count();
     printf("Computation Time: %lf.\n", compute_time);
 
     /* Write wires and costs to files */
-    char cost_filename[256];
-    int n = sprintf(cost_filename, "cost_%s_%d", input_filename, num_of_threads);
-    printf("cost_%s_%d", input_filename, num_of_threads);
-
-    FILE *cost_output = fopen(cost_filename, "w+");
-
-    if (cost_output != NULL){
-        fprintf(cost_output, "%d %d\n", dim_y, dim_x);
-
-        for (int row = 0; row < dim_y; row++){
-            for (int col = 0; col < dim_x; col++){
-                fprintf(cost_output, "%d ", costs[col + row * dim_x]);
-            }
-            fprintf(cost_output, "\n");
-        }
+    auto output_start = Clock::now();
+    double output_time = 0;
 
-        fclose(cost_output);
-    }
+    char cost_filename[256];
+    const char *suffix = binary_output ? ".bin" : "";
+    snprintf(cost_filename, sizeof cost_filename, "cost_%s_%d%s", input_filename, num_of_threads, suffix);
+    printf("%s", cost_filename);
+    write_grid(cost_filename, &grid, dim_x, dim_y, num_of_threads, binary_output);
 
     // wire content
     char wire_filename[256];
-    n = sprintf(wire_filename, "output_%s_%d", input_filename, num_of_threads);
-    printf(wire_filename);
-    FILE *wire_output = fopen(wire_filename, "w+");
-
-    wire_t wire;
-    if (wire_output != NULL){
-        fprintf(wire_output, "%d %d\n", dim_y, dim_x);
-        fprintf(wire_output, "%d \n", num_of_wires);
-
-        for (int w = 0; w < num_of_wires; w++){
-            wire = wires[w];
-
-            if (wire.bend_1){
-                if (wire.startx == wire.bend_1x){
-                    // vertical until bend 1
-                    if (wire.starty < wire.bend_1y){
-                        for (int y_step = wire.starty; y_step < wire.bend_1y; y_step++){
-                            fprintf(wire_output, "%d %d ", wire.startx, y_step);
-                        }
-                    } else{
-                        for (int y_step = wire.starty; y_step > wire.bend_1y; y_step--){
-                            fprintf(wire_output, "%d %d ", wire.startx, y_step);
-                        }
-                    }
-
-                    if (wire.bend_2){
-                        // horizontal until bend 2
-                        if (wire.bend_1x < wire.bend_2x){
-                            for (int step = wire.bend_1x; step < wire.bend_2x; step++){
-                                fprintf(wire_output, "%d %d ", step, wire.bend_1y);
-                            }
-                        } else{
-                            for (int step = wire.bend_1x; step > wire.bend_2x; step--){
-                                fprintf(wire_output, "%d %d ", step, wire.bend_1y);
-                            }
-                        }
-
-                        // vertical from bend 2 to end
-                        if (wire.bend_2y < wire.endy){
-                            for (int y_step = wire.bend_2y; y_step <= wire.endy; y_step++){
-                                fprintf(wire_output, "%d %d ", wire.bend_2x, y_step);
-                            }
-                        } else {
-                            for (int y_step = wire.bend_2y; y_step >= wire.endy; y_step--){
-                                fprintf(wire_output, "%d %d ", wire.bend_2x, y_step);
-                            }
-                        }
-
-                    } else{
-                        // only bend 1
-
-                        // horizontal from bend 1 to end
-                        if (wire.bend_1x < wire.endx){
-                            for (int step = wire.bend_1x; step <= wire.endx; step++){
-                                fprintf(wire_output, "%d %d ", step, wire.bend_1y);
-                            }
-                        } else{
-                            for (int step = wire.bend_1x; step >= wire.endx; step--){
-                                fprintf(wire_output, "%d %d ", step, wire.bend_1y);
-                            }
-                        }
-                    }
-
-                } else if (wire.starty == wire.bend_1y){
-                    // horizontal from start to bend 1
-                    if (wire.startx < wire.bend_1x){
-                        for (int step = wire.startx; step < wire.bend_1x; step++){
-                            fprintf(wire_output, "%d %d ", step, wire.starty);
-                        }
-                    } else{
-                        for (int step = wire.startx; step > wire.bend_1x; step--){
-                            fprintf(wire_output, "%d %d ", step, wire.starty);
-                        }
-                    }
-
-                    if (wire.bend_2){
-                        // vertical from bend 1 to bend 2
-                        if (wire.bend_1y < wire.bend_2y){
-                            for (int step = wire.bend_1y; step < wire.bend_2y; step++){
-                                fprintf(wire_output, "%d %d ", wire.bend_1x, step);
-                            }
-                        } else{
-                            for (int step = wire.bend_1y; step > wire.bend_2y; step--){
-                                fprintf(wire_output, "%d %d ", wire.bend_1x, step);
-                            }
-                        }
-
-                        // horizontal from bend 2 to end
-                        if (wire.bend_2x < wire.endx){
-                            for (int x_step = wire.bend_2x; x_step <= wire.endx; x_step++){
-                                fprintf(wire_output, "%d %d ", x_step, wire.bend_2y);
-                            }
-                        } else {
-                            for (int x_step = wire.bend_2x; x_step >= wire.endx; x_step--){
-                                fprintf(wire_output, "%d %d ", x_step, wire.bend_2y);
-                            }
-                        }
-
-                    } else{
-                        // only bend 1
-
-                        // vertical from bend 1 to end
-                        if (wire.bend_1y < wire.endy){
-                            for (int step = wire.bend_1y; step <= wire.endy; step++){
-                                fprintf(wire_output, "%d %d ", wire.endx, step);
-                            }
-                        } else{
-                            for (int step = wire.bend_1y; step >= wire.endy; step--){
-                                fprintf(wire_output, "%d %d ", wire.endx, step);
-                            }
-                        }
-                    }
-                } 
-            } else{
-                // no bends
-                if (wire.startx == wire.endx){
-                    // vertical line from start to end
-                    if (wire.starty < wire.endy){
-                        for (int step = wire.starty; step <= wire.endy; step++){
-                            fprintf(wire_output, "%d %d ", wire.startx, step);
-                        }
-                    } else{
-                        for (int step = wire.starty; step >= wire.endy; step--){
-                            fprintf(wire_output, "%d %d ", wire.startx, step);
-                        }
-                    }
-
-                } else if (wire.starty == wire.endy){
-                    if (wire.startx < wire.endx){
-                        for (int step = wire.startx; step <= wire.endx; step++){
-                            fprintf(wire_output, "%d %d ", step, wire.endy);
-                        }
-                    } else{
-                        for (int step = wire.startx; step >= wire.endx; step--){
-                            fprintf(wire_output, "%d %d ", step, wire.endy);
-                        }
-                    }
-                }
-            }
-            // fprintf(wire_output, "%d %d ", wires[w].bend_1x, wires[w].bend_1y);
+    snprintf(wire_filename, sizeof wire_filename, "output_%s_%d%s", input_filename, num_of_threads, suffix);
+    printf("%s", wire_filename);
+    if (input_index) {
+        wires_restore(&wires, input_index, num_of_threads);
+        free(input_index);
+    }
+    if (binary_output) {
+        write_routes_bin(wire_filename, &wires, dim_x, dim_y, num_of_threads);
+    } else {
+        write_routes(wire_filename, &wires, dim_x, dim_y, num_of_threads);
+    }
 
-            fprintf(wire_output, "\n");
+    output_time += duration_cast<dsec>(Clock::now() - output_start).count();
+    printf("\nOutput Time: %lf.\n", output_time);
+
+    if (report_filename) {
+        char threads_value[16], seed_value[16], iters_value[16], prob_value[32], decay_value[32], gain_value[32];
+        snprintf(threads_value, sizeof(threads_value), "%d", num_of_threads);
+        snprintf(seed_value, sizeof(seed_value), "%d", seed);
+        snprintf(iters_value, sizeof(iters_value), "%d", SA_iters);
+        snprintf(prob_value, sizeof(prob_value), "%g", SA_prob);
+        snprintf(decay_value, sizeof(decay_value), "%g", SA_decay);
+        snprintf(gain_value, sizeof(gain_value), "%g", min_gain);
+        const char *names[] = {"input", "threads", "mode", "objective", "format", "layout", "kernels",
+                               "order", "balance", "seed", "iterations", "prob", "decay", "threshold"};
+        const char *values[] = {input_filename, threads_value, mode_name, objective_name, format_name,
+                                layout_name, simd->name, order_name, balance_name, seed_value, iters_value,
+                                prob_value, decay_value, gain_value};
+        if (!write_report(report_filename, names, values, sizeof(names) / sizeof(names[0]), &stats,
+                          dim_x, dim_y, num_of_wires, cell_bits(grid.width),
+                          init_time, compute_time, output_time)) {
+            error = 1;
+        } else {
+            printf("Report: %s\n", report_filename);
         }
-
-        fclose(wire_output);
     }
+    stats_free(&stats);
+
+    wires_free(&wires);
+    free(grid.cells);
 
     //printf("owari\n");
-    return 0;
+    return error;
 }
  
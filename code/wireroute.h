@@ -7,26 +7,102 @@
 #define __WIREOPT_H__
 
 #include <omp.h>
+#include <stdint.h>
 
-typedef struct { /* Define the data structure for wire here */
+/* Grid coordinates as stored in wires_t. 16 bits cover grids up to 65536
+ * cells on a side; build with -DWIREROUTE_WIDE_COORDS for larger ones. */
+#ifdef WIREROUTE_WIDE_COORDS
+typedef int32_t coord_t;
+#define COORD_MAX INT32_MAX
+#else
+typedef uint16_t coord_t;
+#define COORD_MAX UINT16_MAX
+#endif
+
+/* A route has at most two bends and is fully described by its endpoints, the
+ * direction it leaves the start point in and where it bends:
+ *   horizontal first: start row -> column `bend` -> end row
+ *   vertical first:   start column -> row `bend` -> end column
+ * A straight wire is stored horizontal first with bend == endx. */
+typedef struct { /* one wire, unpacked from wires_t while it is routed */
     int startx;
     int starty;
     int endx;
     int endy;
 
-    bool bend_1;
-    bool bend_2;
-
-    int bend_1x;
-    int bend_1y;
-    int bend_2x;
-    int bend_2y;
-
-    int total_cost;
+    int bend;
+    bool vertical_first;
 } wire_t;
 
+typedef struct { /* all wires, structure of arrays */
+    int num_wires;
+    coord_t *startx;
+    coord_t *starty;
+    coord_t *endx;
+    coord_t *endy;
+    coord_t *bend;
+    uint8_t *vertical_first;
+} wires_t;
+
 typedef int cost_t;
 
+/* Element type of the cost grid: chosen at startup, widened when a cell
+ * saturates */
+typedef enum {
+    CELL_8,  /* uint8_t */
+    CELL_16, /* uint16_t */
+    CELL_32, /* cost_t */
+} cell_width_t;
+
+/* How the cells of the grid are laid out in memory */
+typedef enum {
+    LAYOUT_ROWS,  /* row major */
+    LAYOUT_TILES, /* GRID_TILE x GRID_TILE tiles, row major inside a tile and
+                   * across tiles, so a vertical walk stays in one tile (and
+                   * mostly in the same pages) for GRID_TILE cells */
+    LAYOUT_DUAL,  /* row major followed by a transposed (column major) copy,
+                   * both kept up to date, so columns are read contiguously */
+} grid_layout_t;
+
+#define GRID_TILE 32
+
+typedef struct {
+    cell_width_t width;
+    grid_layout_t layout;
+    void *cells; /* every cell of the grid at that width and layout */
+} grid_t;
+
+/* How routing() distributes work and synchronizes on the cost array */
+typedef enum {
+    MODE_ACROSS, /* across wires, critical sections around grid access */
+    MODE_ATOMIC, /* across wires, relaxed atomic grid updates, lock-free reads */
+    MODE_WITHIN, /* one wire at a time, its candidates split across threads */
+    MODE_COLOR,  /* lock-free batches of wires with disjoint bounding boxes */
+    MODE_REGION, /* strips of the grid owned by one thread each, then the wires
+                  * crossing strips under the locks of the strips they span */
+} route_mode_t;
+
+/* What routing() minimizes when it picks a route for a wire */
+typedef enum {
+    OBJECTIVE_SUM, /* sum of the cells on the route */
+    OBJECTIVE_MAX, /* highest cell on the route first, then the sum */
+} objective_t;
+
+/* How the across-wire modes hand wires to threads */
+typedef enum {
+    BALANCE_STATIC, /* one contiguous block of wires per thread */
+    BALANCE_LPT,    /* heaviest wires first, one at a time to whichever thread is free */
+    BALANCE_STEAL,  /* blocks of equal estimated work, idle threads steal from the others */
+} balance_t;
+
+/* Order in which routing() visits the wires; routes are always written in
+ * input order */
+typedef enum {
+    ORDER_INPUT,   /* as in the input file */
+    ORDER_HILBERT, /* along a Hilbert curve through the bounding-box centers */
+    ORDER_MORTON,  /* along a Z-order (Morton) curve through the centers */
+} wire_order_t;
+
 const char *get_option_string(const char *option_name, const char *default_value);
 int get_option_int(const char *option_name, int default_value);
 float get_option_float(const char *option_name, float default_value);
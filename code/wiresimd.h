@@ -0,0 +1,273 @@
+/**
+ * Vector kernels for the hot loops of candidate scoring, in a scalar, an
+ * SSE4.1 and an AVX2 version picked at runtime (wireroute -k)
+ *
+ * All of them do plain 32-bit integer adds and maxima, so every version
+ * returns exactly what the scalar one does and the routes never depend on
+ * which one ran.
+ *   sum:        total of a run of cells
+ *   accumulate: total of a run of cells, each also added into colsum
+ *   bends:      out[i] = c + sa * a[i] + mid[i] + sb * b[i], sa and sb +-1
+ *   max3:       out[i] = max(a[i], mid[i], b[i])
+ */
+
+#ifndef __WIRESIMD_H__
+#define __WIRESIMD_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WIRESIMD_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    const char *name;
+    int (*sum_8)(const uint8_t *row, int len);
+    int (*sum_16)(const uint16_t *row, int len);
+    int (*sum_32)(const int *row, int len);
+    int (*accumulate_8)(const uint8_t *row, int len, int *colsum);
+    int (*accumulate_16)(const uint16_t *row, int len, int *colsum);
+    int (*accumulate_32)(const int *row, int len, int *colsum);
+    void (*bends)(int *out, int c, const int *a, int sa, const int *mid, const int *b, int sb, int n);
+    void (*max3)(int *out, const int *a, const int *mid, const int *b, int n);
+} simd_t;
+
+/* the kernel of a simd_t for each cell type */
+static inline int simd_sum(const simd_t *s, const uint8_t *row, int len){ return s->sum_8(row, len); }
+static inline int simd_sum(const simd_t *s, const uint16_t *row, int len){ return s->sum_16(row, len); }
+static inline int simd_sum(const simd_t *s, const int *row, int len){ return s->sum_32(row, len); }
+
+static inline int simd_accumulate(const simd_t *s, const uint8_t *row, int len, int *colsum){
+    return s->accumulate_8(row, len, colsum);
+}
+static inline int simd_accumulate(const simd_t *s, const uint16_t *row, int len, int *colsum){
+    return s->accumulate_16(row, len, colsum);
+}
+static inline int simd_accumulate(const simd_t *s, const int *row, int len, int *colsum){
+    return s->accumulate_32(row, len, colsum);
+}
+
+/* scalar, the reference the vector versions must match */
+
+template <typename CELL>
+static int sum_scalar(const CELL *row, int len){
+    int total = 0;
+    for (int i = 0; i < len; i++) total += row[i];
+    return total;
+}
+
+template <typename CELL>
+static int accumulate_scalar(const CELL *row, int len, int *colsum){
+    int total = 0;
+    for (int i = 0; i < len; i++){
+        total += row[i];
+        colsum[i] += row[i];
+    }
+    return total;
+}
+
+static void bends_scalar(int *out, int c, const int *a, int sa, const int *mid, const int *b, int sb, int n){
+    for (int i = 0; i < n; i++) out[i] = c + sa * a[i] + mid[i] + sb * b[i];
+}
+
+static void max3_scalar(int *out, const int *a, const int *mid, const int *b, int n){
+    for (int i = 0; i < n; i++) out[i] = std::max(std::max(a[i], mid[i]), b[i]);
+}
+
+static const simd_t simd_scalar = {
+    "scalar",
+    sum_scalar<uint8_t>, sum_scalar<uint16_t>, sum_scalar<int>,
+    accumulate_scalar<uint8_t>, accumulate_scalar<uint16_t>, accumulate_scalar<int>,
+    bends_scalar, max3_scalar
+};
+
+#ifdef WIRESIMD_X86
+
+/* SSE4.1, 4 cells per step widened to 32 bits */
+
+__attribute__((target("sse4.1")))
+static inline __m128i load4(const uint8_t *p){
+    int v;
+    memcpy(&v, p, sizeof(v));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i load4(const uint16_t *p){
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i load4(const int *p){
+    return _mm_loadu_si128((const __m128i*)p);
+}
+
+__attribute__((target("sse4.1")))
+static inline int hsum4(__m128i v){
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+    return _mm_cvtsi128_si32(v);
+}
+
+template <typename CELL>
+__attribute__((target("sse4.1")))
+static int sum_sse41(const CELL *row, int len){
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= len; i += 4) acc = _mm_add_epi32(acc, load4(row + i));
+    int total = hsum4(acc);
+    for (; i < len; i++) total += row[i];
+    return total;
+}
+
+template <typename CELL>
+__attribute__((target("sse4.1")))
+static int accumulate_sse41(const CELL *row, int len, int *colsum){
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= len; i += 4){
+        __m128i v = load4(row + i);
+        acc = _mm_add_epi32(acc, v);
+        _mm_storeu_si128((__m128i*)(colsum + i), _mm_add_epi32(load4(colsum + i), v));
+    }
+    int total = hsum4(acc);
+    for (; i < len; i++){
+        total += row[i];
+        colsum[i] += row[i];
+    }
+    return total;
+}
+
+__attribute__((target("sse4.1")))
+static void bends_sse41(int *out, int c, const int *a, int sa, const int *mid, const int *b, int sb, int n){
+    __m128i vc = _mm_set1_epi32(c), va = _mm_set1_epi32(sa), vb = _mm_set1_epi32(sb);
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        __m128i v = _mm_add_epi32(vc, _mm_sign_epi32(load4(a + i), va));
+        v = _mm_add_epi32(v, load4(mid + i));
+        v = _mm_add_epi32(v, _mm_sign_epi32(load4(b + i), vb));
+        _mm_storeu_si128((__m128i*)(out + i), v);
+    }
+    bends_scalar(out + i, c, a + i, sa, mid + i, b + i, sb, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void max3_sse41(int *out, const int *a, const int *mid, const int *b, int n){
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        __m128i v = _mm_max_epi32(_mm_max_epi32(load4(a + i), load4(mid + i)), load4(b + i));
+        _mm_storeu_si128((__m128i*)(out + i), v);
+    }
+    max3_scalar(out + i, a + i, mid + i, b + i, n - i);
+}
+
+static const simd_t simd_sse41 = {
+    "sse4.1",
+    sum_sse41<uint8_t>, sum_sse41<uint16_t>, sum_sse41<int>,
+    accumulate_sse41<uint8_t>, accumulate_sse41<uint16_t>, accumulate_sse41<int>,
+    bends_sse41, max3_sse41
+};
+
+/* AVX2, 8 cells per step */
+
+__attribute__((target("avx2")))
+static inline __m256i load8(const uint8_t *p){
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load8(const uint16_t *p){
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load8(const int *p){
+    return _mm256_loadu_si256((const __m256i*)p);
+}
+
+__attribute__((target("avx2")))
+static inline int hsum8(__m256i v){
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+template <typename CELL>
+__attribute__((target("avx2")))
+static int sum_avx2(const CELL *row, int len){
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= len; i += 8) acc = _mm256_add_epi32(acc, load8(row + i));
+    int total = hsum8(acc);
+    for (; i < len; i++) total += row[i];
+    return total;
+}
+
+template <typename CELL>
+__attribute__((target("avx2")))
+static int accumulate_avx2(const CELL *row, int len, int *colsum){
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= len; i += 8){
+        __m256i v = load8(row + i);
+        acc = _mm256_add_epi32(acc, v);
+        _mm256_storeu_si256((__m256i*)(colsum + i), _mm256_add_epi32(load8(colsum + i), v));
+    }
+    int total = hsum8(acc);
+    for (; i < len; i++){
+        total += row[i];
+        colsum[i] += row[i];
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+static void bends_avx2(int *out, int c, const int *a, int sa, const int *mid, const int *b, int sb, int n){
+    __m256i vc = _mm256_set1_epi32(c), va = _mm256_set1_epi32(sa), vb = _mm256_set1_epi32(sb);
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256i v = _mm256_add_epi32(vc, _mm256_sign_epi32(load8(a + i), va));
+        v = _mm256_add_epi32(v, load8(mid + i));
+        v = _mm256_add_epi32(v, _mm256_sign_epi32(load8(b + i), vb));
+        _mm256_storeu_si256((__m256i*)(out + i), v);
+    }
+    bends_scalar(out + i, c, a + i, sa, mid + i, b + i, sb, n - i);
+}
+
+__attribute__((target("avx2")))
+static void max3_avx2(int *out, const int *a, const int *mid, const int *b, int n){
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256i v = _mm256_max_epi32(_mm256_max_epi32(load8(a + i), load8(mid + i)), load8(b + i));
+        _mm256_storeu_si256((__m256i*)(out + i), v);
+    }
+    max3_scalar(out + i, a + i, mid + i, b + i, n - i);
+}
+
+static const simd_t simd_avx2 = {
+    "avx2",
+    sum_avx2<uint8_t>, sum_avx2<uint16_t>, sum_avx2<int>,
+    accumulate_avx2<uint8_t>, accumulate_avx2<uint16_t>, accumulate_avx2<int>,
+    bends_avx2, max3_avx2
+};
+
+#endif
+
+/* the kernels called name ("auto" for the widest this CPU runs), NULL if
+ * unknown or not supported here */
+static inline const simd_t *simd_select(const char *name){
+    bool is_auto = strcmp(name, "auto") == 0;
+#ifdef WIRESIMD_X86
+    __builtin_cpu_init();
+    if ((is_auto || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) return &simd_avx2;
+    if ((is_auto || strcmp(name, "sse4.1") == 0) && __builtin_cpu_supports("sse4.1")) return &simd_sse41;
+#endif
+    if (is_auto || strcmp(name, "scalar") == 0) return &simd_scalar;
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * Checks every kernel set of wiresimd.h this CPU runs against the scalar
+ * one, bit for bit: random rows of every cell width, lengths 0..LEN_MAX so
+ * every vector tail is hit, values up to the limit of the cell width, and
+ * rows that start off vector alignment. Run with "make test".
+ */
+
+#include "wiresimd.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits.h>
+
+// longest row tried, past a few full AVX2 steps
+#define LEN_MAX 67
+// random rows per length and alignment
+#define ROUNDS 20
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(){
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+// a value in [0, limit], half of them within 4 of limit
+static long long near_limit(long long limit){
+    long long v = (long long)(next_random() % (uint64_t)(limit + 1));
+    return (next_random() & 1) ? v : std::max(0LL, limit - (long long)(next_random() % 5));
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *kernels, const char *what, int len, int offset){
+    if (ok) return;
+    if (failures < 20) printf("FAIL %s %s, length %d, offset %d\n", kernels, what, len, offset);
+    failures++;
+}
+
+// sum and accumulate of a row of CELLs holding values up to limit
+template <typename CELL>
+static void test_rows(const simd_t *s, const char *cell_name, long long limit){
+    CELL row[LEN_MAX + 8];
+    int colsum[LEN_MAX + 8], colsum_ref[LEN_MAX + 8];
+    char what[64];
+
+    for (int len = 0; len <= LEN_MAX; len++){
+        for (int offset = 0; offset < 4; offset++){
+            for (int r = 0; r < ROUNDS; r++){
+                for (int i = 0; i < len + offset; i++) row[i] = (CELL)near_limit(limit);
+                for (int i = 0; i < len + offset; i++){
+                    colsum[i] = colsum_ref[i] = (int)(next_random() % (1 << 20)) - (1 << 19);
+                }
+                const CELL *p = row + offset;
+
+                snprintf(what, sizeof(what), "sum of %s cells", cell_name);
+                check(simd_sum(s, p, len) == simd_sum(&simd_scalar, p, len), s->name, what, len, offset);
+
+                snprintf(what, sizeof(what), "accumulate of %s cells", cell_name);
+                int total = simd_accumulate(s, p, len, colsum + offset);
+                int total_ref = simd_accumulate(&simd_scalar, p, len, colsum_ref + offset);
+                check(total == total_ref && memcmp(colsum, colsum_ref, (len + offset) * sizeof(int)) == 0,
+                      s->name, what, len, offset);
+            }
+        }
+    }
+}
+
+// bends and max3, with values that cannot overflow the sum of three
+static void test_candidates(const simd_t *s){
+    int a[LEN_MAX + 8], mid[LEN_MAX + 8], b[LEN_MAX + 8];
+    int out[LEN_MAX + 8], out_ref[LEN_MAX + 8];
+    const int extremes[] = {0, 1, -1, INT_MAX / 4, -(INT_MAX / 4)};
+
+    for (int len = 0; len <= LEN_MAX; len++){
+        for (int offset = 0; offset < 4; offset++){
+            for (int r = 0; r < ROUNDS; r++){
+                for (int i = 0; i < len + offset; i++){
+                    bool extreme = (next_random() % 4) == 0;
+                    a[i] = extreme ? extremes[next_random() % 5] : (int)(next_random() % 2000001) - 1000000;
+                    mid[i] = extreme ? extremes[next_random() % 5] : (int)(next_random() % 2000001) - 1000000;
+                    b[i] = extreme ? extremes[next_random() % 5] : (int)(next_random() % 2000001) - 1000000;
+                }
+                int c = (int)(next_random() % 2000001) - 1000000;
+                int sa = (next_random() & 1) ? 1 : -1, sb = (next_random() & 1) ? 1 : -1;
+
+                memset(out, 0, sizeof(out));
+                memset(out_ref, 0, sizeof(out_ref));
+                s->bends(out + offset, c, a + offset, sa, mid + offset, b + offset, sb, len);
+                simd_scalar.bends(out_ref + offset, c, a + offset, sa, mid + offset, b + offset, sb, len);
+                check(memcmp(out, out_ref, sizeof(out)) == 0, s->name, "bends", len, offset);
+
+                memset(out, 0, sizeof(out));
+                memset(out_ref, 0, sizeof(out_ref));
+                s->max3(out + offset, a + offset, mid + offset, b + offset, len);
+                simd_scalar.max3(out_ref + offset, a + offset, mid + offset, b + offset, len);
+                check(memcmp(out, out_ref, sizeof(out)) == 0, s->name, "max3", len, offset);
+            }
+        }
+    }
+}
+
+int main(){
+    const char *names[] = {"sse4.1", "avx2"};
+    int tested = 0;
+    for (int k = 0; k < 2; k++){
+        const simd_t *s = simd_select(names[k]);
+        if (s == NULL){
+            printf("%s: not supported by this CPU, skipped\n", names[k]);
+            continue;
+        }
+        int before = failures;
+        // a row of LEN_MAX 32-bit cells must not overflow its int sum
+        test_rows<uint8_t>(s, "8-bit", UINT8_MAX);
+        test_rows<uint16_t>(s, "16-bit", UINT16_MAX);
+        test_rows<int>(s, "32-bit", INT_MAX / (LEN_MAX + 1));
+        test_candidates(s);
+        printf("%s: %s\n", s->name, failures == before ? "matches scalar" : "MISMATCH");
+        tested++;
+    }
+    if (tested == 0) printf("Only the scalar kernels run here, nothing to compare.\n");
+    return failures ? 1 : 0;
+}
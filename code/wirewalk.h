@@ -0,0 +1,73 @@
+/**
+ * The cells of a route, shared by wireroute (reading, adding, clearing and
+ * writing routes) and wireconvert (writing the text version of a binary route
+ * file), so both always agree on which cells a route covers and in what order
+ */
+
+#ifndef __WIREWALK_H__
+#define __WIREWALK_H__
+
+#include "wireroute.h"
+#include <stdlib.h>
+
+// the four corners of a route: start, the two ends of the bend segment, end.
+// Straight wires are routed horizontal first with the bend at endx, so some of
+// the corners coincide.
+static inline void route_corners(wire_t wire, int *px, int *py){
+    px[0] = wire.startx; py[0] = wire.starty;
+    if (wire.vertical_first){
+        px[1] = wire.startx; py[1] = wire.bend;
+        px[2] = wire.endx;   py[2] = wire.bend;
+    } else{
+        px[1] = wire.bend;   py[1] = wire.starty;
+        px[2] = wire.bend;   py[2] = wire.endy;
+    }
+    px[3] = wire.endx; py[3] = wire.endy;
+}
+
+static inline int sign(int v){
+    return (v > 0) - (v < 0);
+}
+
+// the one walk over the cells of a route: at most three axis-aligned segments,
+// each from one corner up to (not including) the next, then the end cell.
+// Reading, adding, clearing and writing a route are operations handed every
+// segment, specialized at compile time:
+//   op.row(x, y, dir, len):    cells (x, y), (x + dir, y), ... len of them
+//   op.column(x, y, dir, len): cells (x, y), (x, y + dir), ... len of them
+//   op.cell(x, y):             the end cell
+template <typename OP>
+static inline void route_walk(wire_t wire, OP &op){
+    int px[4], py[4];
+    route_corners(wire, px, py);
+
+    for (int s = 0; s < 3; s++){
+        int len_x = px[s + 1] - px[s], len_y = py[s + 1] - py[s];
+        if (len_x) op.row(px[s], py[s], sign(len_x), abs(len_x));
+        else if (len_y) op.column(px[s], py[s], sign(len_y), abs(len_y));
+    }
+    op.cell(wire.endx, wire.endy);
+}
+
+// route_walk operation handing every cell to point(x, y), in order from the
+// start of the route to its end
+template <typename POINT>
+struct route_points_t {
+    POINT point;
+
+    void row(int x, int y, int dir, int len){
+        for (int j = 0; j < len; j++) point(x + j * dir, y);
+    }
+    void column(int x, int y, int dir, int len){
+        for (int j = 0; j < len; j++) point(x, y + j * dir);
+    }
+    void cell(int x, int y){ point(x, y); }
+};
+
+template <typename POINT>
+static inline void route_points(wire_t wire, POINT point){
+    route_points_t<POINT> op = {point};
+    route_walk(wire, op);
+}
+
+#endif